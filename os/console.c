@@ -0,0 +1,89 @@
+// os/console.c
+// 控制台输出缓冲：攒一批字符，用一次 SBI DBCN 调用整段写出
+// 以前每个字符都是一次 ecall 陷入 M 态，打印日志的大部分时间都花在陷入固件上
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void console_putchar(int c);
+int sbi_has_dbcn();
+long sbi_debug_console_write(uint64_t pa, uint64_t len);
+void klog_drain();
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+
+#define CONSOLE_BUF_SIZE 512
+
+// 缓冲区在内核 .bss 里，内核 RAM 是恒等映射，VA 可以直接当 PA 交给固件
+char tx_buf[CONSOLE_BUF_SIZE];
+int tx_len = 0;
+
+// 一条 printf / 一次 sys_write 的输出不会和其他 hart 的交错
+spinlock_t console_lock;
+
+int dbcn_present = 0;   // 固件是否支持 DBCN，不支持就退回逐字符输出
+
+uint64_t console_bytes = 0;     // 写出的总字节数
+uint64_t console_ecalls = 0;    // 为此陷入固件的次数
+
+// 探测 DBCN 扩展，在这之前所有输出都走逐字符的老路
+void console_init() {
+    dbcn_present = sbi_has_dbcn();
+}
+
+// 把缓冲区全部写出，调用者持有 console_lock
+static void console_flush_locked() {
+    int off = 0;
+    while (off < tx_len && dbcn_present) {
+        long n = sbi_debug_console_write((uint64_t)&tx_buf[off], tx_len - off);
+        console_ecalls++;
+        if (n <= 0) {
+            // 固件报错：剩下的改用逐字符输出
+            break;
+        }
+        off += n;
+    }
+    while (off < tx_len) {
+        console_putchar(tx_buf[off++]);
+        console_ecalls++;
+    }
+    console_bytes += tx_len;
+    tx_len = 0;
+}
+
+// 开始一段输出：上锁，之后用 console_putc 往缓冲区里写
+void console_begin() {
+    spin_lock(&console_lock);
+}
+
+// 结束一段输出：写出缓冲区并解锁
+void console_end() {
+    console_flush_locked();
+    spin_unlock(&console_lock);
+}
+
+// 往缓冲区里放一个字符，满了就先写出去 (必须在 console_begin/end 之间调用)
+void console_putc(int c) {
+    if (tx_len == CONSOLE_BUF_SIZE) console_flush_locked();
+    tx_buf[tx_len++] = c;
+}
+
+// 输出一整段数据 (sys_write 用)
+// 先把内核日志环里积压的写出去，用户程序的输出不会跑到内核日志前面
+void console_write(char *buf, uint64_t len) {
+    klog_drain();
+    console_begin();
+    for (uint64_t i = 0; i < len; i++) {
+        console_putc(buf[i]);
+    }
+    console_end();
+}
+
+void console_stats() {
+    uint64_t bytes = console_bytes, ecalls = console_ecalls;
+    printf("[Kernel] console: %s, bytes=%lu, ecalls=%lu\n",
+           dbcn_present ? "DBCN" : "legacy putchar", bytes, ecalls);
+}
@@ -0,0 +1,169 @@
+// os/klog.c
+// 内核日志环 (dmesg)：klog() 只把一行日志格式化进内存里的环形缓冲区，不碰控制台
+// 控制台输出推迟到 klog_drain()：idle 循环、printf 和 sys_write 之前各调用一次
+// 所以热路径 (进程退出、缺页、fork 失败……) 打日志只是几百字节的内存写
+//
+// 每条记录一行："<级别>[秒.微秒] 内容\n"，级别和 Linux 一样 (3 错误 / 4 警告 / 6 信息 / 7 调试)
+//   - 最低级别 LOG_LEVEL 在编译时给定 (make LOG_LEVEL=7)：klog() 入口比较一次，更详细的直接丢掉，不格式化
+//     调用本身还在；要连调用一起去掉，像 paging.c 那样按 LOG_LEVEL 定义 pr_debug() 宏
+//   - 控制台只显示 CONSOLE_LOG_LEVEL 以内的 (不带 "<级别>")，更详细的只留在环里，用 dmesg 看
+// 环满了就覆盖最老的记录，还没输出到控制台就被覆盖的字节记在 klog_lost 里
+#include <stdarg.h>
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void console_putc(int c);
+void console_begin();
+void console_end();
+uint64_t r_time();
+typedef void (*putc_fn)(int c);
+void vprintfmt(putc_fn out, char *fmt, va_list ap);
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+
+#define LOG_ERR 3
+#define LOG_WARN 4
+#define LOG_INFO 6
+#define LOG_DEBUG 7
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#ifndef CONSOLE_LOG_LEVEL
+#define CONSOLE_LOG_LEVEL LOG_INFO
+#endif
+
+#define CLOCK_FREQ 10000000     // QEMU virt 的 timebase 频率
+
+#define KLOG_SIZE 16384         // 2 的幂，位置用累计字节数，取模就是下标
+#define KLOG_MASK (KLOG_SIZE - 1)
+#define KLOG_LINE_MAX 256       // 一条记录最长多少字节 (含换行)，更长的截断
+
+char klog_buf[KLOG_SIZE];
+uint64_t klog_head = 0;         // 下一个字节写到哪 (累计字节数)
+uint64_t klog_drained = 0;      // 已经输出到控制台的位置
+uint64_t klog_lost = 0;         // 还没输出就被覆盖的字节数
+uint64_t klog_records = 0;
+spinlock_t klog_lock;
+
+// 同一时间只有一个 hart 往控制台倒日志，行的先后顺序不会乱
+static volatile int draining = 0;
+
+// 正在写的这条记录的长度 (持有 klog_lock 时有效)
+static int line_len;
+
+static void klog_putc(int c) {
+    // 留一个字节给换行
+    if (line_len >= KLOG_LINE_MAX - 1 || c == '\n' || c == 0) return;
+    klog_buf[klog_head++ & KLOG_MASK] = c;
+    line_len++;
+}
+
+static void klog_format(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintfmt(klog_putc, fmt, ap);
+    va_end(ap);
+}
+
+// 写一条日志。消息本身不用带换行，多行的内容会被截成一行
+void klog(int level, char *fmt, ...) {
+    if (level > LOG_LEVEL) return;
+    uint64_t t = r_time();
+
+    spin_lock(&klog_lock);
+    line_len = 0;
+    klog_format("<%d>[%5lu.%06lu] ", level, t / CLOCK_FREQ, t % CLOCK_FREQ / (CLOCK_FREQ / 1000000));
+    va_list ap;
+    va_start(ap, fmt);
+    vprintfmt(klog_putc, fmt, ap);
+    va_end(ap);
+    klog_buf[klog_head++ & KLOG_MASK] = '\n';
+    klog_records++;
+    spin_unlock(&klog_lock);
+}
+
+// 环里还留着的最老一条完整记录的位置 (调用者持有 klog_lock)
+static uint64_t oldest_locked() {
+    if (klog_head <= KLOG_SIZE) return 0;
+    uint64_t pos = klog_head - KLOG_SIZE;
+    // 环的开头很可能落在一条记录中间，跳到下一行
+    while (pos < klog_head && klog_buf[pos & KLOG_MASK] != '\n') pos++;
+    return pos < klog_head ? pos + 1 : pos;
+}
+
+// 从 *pos 开始取出一整条记录 (到换行为止) 放进 line，返回长度，没有了返回 0
+// *pos 已经被覆盖的话先跳到最老的记录，跳过的字节数加到 *skipped
+static int take_line_locked(uint64_t *pos, char *line, uint64_t *skipped) {
+    if (klog_head > KLOG_SIZE && *pos < klog_head - KLOG_SIZE) {
+        uint64_t oldest = oldest_locked();
+        if (skipped) *skipped += oldest - *pos;
+        *pos = oldest;
+    }
+    int n = 0;
+    while (*pos < klog_head && n < KLOG_LINE_MAX) {
+        char c = klog_buf[(*pos)++ & KLOG_MASK];
+        line[n++] = c;
+        if (c == '\n') break;
+    }
+    return n;
+}
+
+// 把还没输出的日志写到控制台：一次取一行，放开日志锁以后再写 (写控制台要陷入固件，很慢)
+void klog_drain() {
+    // 没有新日志时只是一次比较
+    if (klog_drained == klog_head) return;
+    if (__sync_lock_test_and_set(&draining, 1) != 0) return;
+
+    char line[KLOG_LINE_MAX];
+    for (;;) {
+        uint64_t lost = 0;
+        spin_lock(&klog_lock);
+        int n = take_line_locked(&klog_drained, line, &lost);
+        klog_lost += lost;
+        spin_unlock(&klog_lock);
+        // 这里的 printf 不会再进来 (draining 已经置上)
+        if (lost) printf("[Kernel] klog: %lu bytes overwritten before reaching the console\n", lost);
+        if (n == 0) break;
+
+        // 去掉 "<级别>"，太详细的不上控制台
+        int level = line[1] - '0';
+        if (level > CONSOLE_LOG_LEVEL) continue;
+        console_begin();
+        for (int i = 3; i < n; i++) console_putc(line[i]);
+        console_end();
+    }
+    __sync_lock_release(&draining);
+}
+
+// sys_dmesg(buf, len)：把环里保留的日志 (从最老的完整记录开始，带 "<级别>") 复制给用户
+// 返回复制的字节数；len 不够时只给前面的部分
+int sys_dmesg(char *buf, int len) {
+    char line[KLOG_LINE_MAX];
+    spin_lock(&klog_lock);
+    uint64_t pos = oldest_locked();
+    spin_unlock(&klog_lock);
+
+    int copied = 0;
+    while (copied < len) {
+        spin_lock(&klog_lock);
+        int n = take_line_locked(&pos, line, 0);
+        spin_unlock(&klog_lock);
+        if (n == 0) break;
+        if (n > len - copied) n = len - copied;
+        // 放开锁以后再写用户缓冲区 (可能触发 COW 缺页，缺页处理本身也可能写日志)
+        for (int i = 0; i < n; i++) buf[copied + i] = line[i];
+        copied += n;
+    }
+    return copied;
+}
+
+void klog_stats() {
+    printf("[Kernel] klog: records=%lu, bytes=%lu, lost before console=%lu\n",
+           klog_records, klog_head, klog_lost);
+}
@@ -0,0 +1,289 @@
+// os/loader.c
+// ELF 加载器：应用程序以 ELF 的形式嵌在内核里 (见 link_app.S 的应用表)
+// 每个 PT_LOAD 段按页映射，权限取自段的 p_flags：代码 R|X，只读数据 R，数据 R|W
+// 可写又可执行的段直接拒绝加载 (W^X)
+// 不可写的段 (代码、只读数据) 每个应用只拷贝一次，所有运行它的进程映射同一批物理页
+// 每个段对应进程的一个 VMA；段里超出文件内容的整页 (.bss) 不在这里分配，
+// 第一次访问时由缺页处理分配清零页 (task.c 的 task_page_fault)
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void* frame_alloc();
+void frame_ref(void *pa);
+void frame_dealloc(void *pa);
+void* kmalloc(uint64_t size);
+void kfree(void *p);
+typedef uint64_t* pagetable_t;
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+void* memcpy(void *dst, const void *src, uint64_t n);
+uint64_t* walk(pagetable_t pagetable, uint64_t va, int alloc);
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+
+#define PAGE_SIZE 4096
+#define PGROUNDDOWN(a) (((uint64_t)(a)) & ~(uint64_t)(PAGE_SIZE - 1))
+#define PGROUNDUP(a) PGROUNDDOWN((uint64_t)(a) + PAGE_SIZE - 1)
+
+#define PTE_V (1L << 0)
+#define PTE_R (1L << 1)
+#define PTE_W (1L << 2)
+#define PTE_X (1L << 3)
+#define PTE_U (1L << 4)
+
+#define USER_TOP 0x80000000L
+
+// --- ELF 格式 ---
+#define ELF_MAGIC 0x464C457FU   // "\x7FELF" 小端
+#define ELFCLASS64 2
+#define ET_EXEC 2
+#define EM_RISCV 243
+#define PT_LOAD 1
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
+
+typedef struct {
+    uint32_t magic;
+    uint8_t elf_class;
+    uint8_t data;
+    uint8_t version;
+    uint8_t pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t e_version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} ElfHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t off;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} ProgHeader;
+
+// 虚拟内存区域 (和 task.c 里的定义保持一致，这里只用数组，不用 next)
+typedef struct Vma {
+    uint64_t start;
+    uint64_t end;
+    int perm;
+    int flags;
+    struct Vma *next;
+} Vma;
+
+// --- 应用表 (link_app.S) ---
+// _app_table[0] 是应用个数，后面每个应用三项：名字、ELF 起始、ELF 结束
+// 第 0 个应用是开机时运行的第一个进程
+extern uint64_t _app_table[];
+
+int app_count() {
+    return (int)_app_table[0];
+}
+
+static int str_eq(char *a, char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// 取第 i 个应用，返回它的名字
+char* app_get(int i, char **elf, uint64_t *size) {
+    if (i < 0 || i >= app_count()) return 0;
+    uint64_t *ent = &_app_table[1 + 3 * i];
+    *elf = (char *)ent[1];
+    *size = ent[2] - ent[1];
+    return (char *)ent[0];
+}
+
+// 按名字找应用，找不到返回 -1
+int app_find(char *name, char **elf, uint64_t *size) {
+    for (int i = 0; i < app_count(); i++) {
+        if (str_eq(app_get(i, elf, size), name)) return i;
+    }
+    return -1;
+}
+
+// 分配一页，放进段在 [va, va + PAGE_SIZE) 里的文件内容
+// 清零页：段首尾不满一页的部分 (以及 .bss 的开头) 都是 0
+static char* load_page(char *elf, ProgHeader *ph, uint64_t va) {
+    char *page = (char *)frame_alloc();
+    if (page == 0) return 0;
+
+    uint64_t file_end = ph->vaddr + ph->filesz;
+    uint64_t lo = va < ph->vaddr ? ph->vaddr : va;
+    uint64_t hi = va + PAGE_SIZE < file_end ? va + PAGE_SIZE : file_end;
+    memcpy(page + (lo - va), elf + ph->off + (lo - ph->vaddr), hi - lo);
+    return page;
+}
+
+// --- 只读段的共享页 ---
+// 同一个应用的代码和只读数据在每个进程里都一样：第一次加载时拷贝一份放进表里，
+// 以后再启动这个应用 (exec) 直接映射同一批物理页，每个映射 frame_ref 一次，进程只有可写的页是自己的
+// 表本身持有每页的一个引用，所有进程都退出后页还留着，下一次启动也不用拷贝
+// 应用是嵌在内核里的固定几个，表项不回收，占用的就是所有应用只读段的大小
+#define MAX_SHARED_SEGS 16
+#define SHARED_SEG_MAX_PAGES (2048 / 8)     // 页数组用 kmalloc 分配，最大 2KB
+
+typedef struct {
+    char *elf;              // 哪个应用 (内核里嵌入的 ELF 地址)
+    uint64_t start;         // 段的第一页
+    int npages;             // 有文件内容的页数
+    uint64_t *pages;
+} SharedSeg;
+
+static SharedSeg shared_segs[MAX_SHARED_SEGS];
+static int nr_shared_segs = 0;
+static spinlock_t shared_lock;
+
+uint64_t shared_pages = 0;      // 表里的物理页数
+uint64_t shared_mapped = 0;     // 直接映射共享页 (省掉一次分配和拷贝) 的次数
+
+// 找到 (或第一次加载) 只读段的共享页，返回页数组，第 i 项是段的第 i 页
+// 表满了、段太大、内存不够时返回 0，调用者退回每个进程拷贝一份
+static uint64_t* shared_segment(char *elf, ProgHeader *ph) {
+    uint64_t start = PGROUNDDOWN(ph->vaddr);
+    int npages = (PGROUNDUP(ph->vaddr + ph->filesz) - start) / PAGE_SIZE;
+
+    spin_lock(&shared_lock);
+    for (int i = 0; i < nr_shared_segs; i++) {
+        SharedSeg *s = &shared_segs[i];
+        if (s->elf == elf && s->start == start && s->npages == npages) {
+            spin_unlock(&shared_lock);
+            return s->pages;
+        }
+    }
+    if (nr_shared_segs == MAX_SHARED_SEGS || npages > SHARED_SEG_MAX_PAGES) {
+        spin_unlock(&shared_lock);
+        return 0;
+    }
+
+    // 第一次：在锁里加载完整个段，别的 hart 同时 exec 同一个应用时等着用这一份
+    uint64_t *pages = (uint64_t *)kmalloc(npages * sizeof(uint64_t));
+    int n = 0;
+    while (pages && n < npages) {
+        char *page = load_page(elf, ph, start + (uint64_t)n * PAGE_SIZE);
+        if (page == 0) break;
+        pages[n++] = (uint64_t)page;
+    }
+    if (pages == 0 || n < npages) {
+        for (int i = 0; i < n; i++) frame_dealloc((void *)pages[i]);
+        kfree(pages);
+        spin_unlock(&shared_lock);
+        return 0;
+    }
+
+    SharedSeg *s = &shared_segs[nr_shared_segs++];
+    s->elf = elf;
+    s->start = start;
+    s->npages = npages;
+    s->pages = pages;
+    shared_pages += npages;
+    spin_unlock(&shared_lock);
+    return pages;
+}
+
+void loader_stats() {
+    printf("[Kernel] loader: shared read-only segments=%d, pages=%lu, mapped without copy=%lu\n",
+           nr_shared_segs, shared_pages, shared_mapped);
+}
+
+// 把 elf[0, size) 加载进 pagetable
+// 成功返回 0，*entry 为入口地址，vmas/nr_vmas 为每个段的 VMA
+// 失败返回 -1 (已经映射的页留在 pagetable 里，由调用者整张释放)
+int elf_load(pagetable_t pagetable, char *elf, uint64_t size, uint64_t *entry,
+             Vma *vmas, int max_vmas, int *nr_vmas) {
+    ElfHeader *eh = (ElfHeader *)elf;
+    if (size < sizeof(ElfHeader) || eh->magic != ELF_MAGIC || eh->elf_class != ELFCLASS64 ||
+        eh->type != ET_EXEC || eh->machine != EM_RISCV) {
+        printf("[Kernel] elf_load: not a RISC-V 64-bit executable\n");
+        return -1;
+    }
+    if (eh->phoff + (uint64_t)eh->phnum * sizeof(ProgHeader) > size) {
+        printf("[Kernel] elf_load: bad program header table\n");
+        return -1;
+    }
+
+    *nr_vmas = 0;
+    for (int i = 0; i < eh->phnum; i++) {
+        ProgHeader *ph = (ProgHeader *)(elf + eh->phoff + i * sizeof(ProgHeader));
+        if (ph->type != PT_LOAD || ph->memsz == 0) continue;
+
+        if (ph->filesz > ph->memsz || ph->off + ph->filesz > size ||
+            ph->vaddr + ph->memsz > USER_TOP || ph->vaddr + ph->memsz < ph->vaddr) {
+            printf("[Kernel] elf_load: bad segment at %lx\n", ph->vaddr);
+            return -1;
+        }
+        if ((ph->flags & PF_W) && (ph->flags & PF_X)) {
+            printf("[Kernel] elf_load: segment at %lx is writable and executable\n", ph->vaddr);
+            return -1;
+        }
+
+        int perm = PTE_U;
+        if (ph->flags & PF_R) perm |= PTE_R;
+        if (ph->flags & PF_W) perm |= PTE_W | PTE_R;
+        if (ph->flags & PF_X) perm |= PTE_X;
+
+        // 1. 有文件内容的页：只读段映射共享页，可写段分配、拷贝、映射
+        uint64_t file_end = ph->vaddr + ph->filesz;
+        uint64_t *shared = (perm & PTE_W) ? 0 : shared_segment(elf, ph);
+        for (uint64_t va = PGROUNDDOWN(ph->vaddr); va < file_end; va += PAGE_SIZE) {
+            uint64_t *pte = walk(pagetable, va, 0);
+            if (pte && (*pte & PTE_V)) {
+                // 段之间共用一页会让两种权限混在一起，user/linker.ld 让各段按页对齐
+                printf("[Kernel] elf_load: segments overlap at page %lx\n", va);
+                return -1;
+            }
+
+            char *page;
+            if (shared) {
+                page = (char *)shared[(va - PGROUNDDOWN(ph->vaddr)) / PAGE_SIZE];
+                frame_ref(page);
+                __sync_fetch_and_add(&shared_mapped, 1);
+            } else {
+                page = load_page(elf, ph, va);
+                if (page == 0) return -1;
+            }
+
+            if (uvm_map(pagetable, va, (uint64_t)page, PAGE_SIZE, perm) != 0) {
+                frame_dealloc(page);
+                return -1;
+            }
+        }
+
+        // 2. 整个段 (包括 .bss) 记成一个 VMA，剩下没映射的页访问时再分配
+        if (*nr_vmas == max_vmas) {
+            printf("[Kernel] elf_load: too many segments\n");
+            return -1;
+        }
+        vmas[*nr_vmas].start = PGROUNDDOWN(ph->vaddr);
+        vmas[*nr_vmas].end = PGROUNDUP(ph->vaddr + ph->memsz);
+        vmas[*nr_vmas].perm = perm;
+        vmas[*nr_vmas].flags = 0;
+        vmas[*nr_vmas].next = 0;
+        (*nr_vmas)++;
+    }
+
+    // 刚写进去的代码要对取指可见 (共享页第一次加载时也是在这个 hart 上写的)
+    asm volatile("fence.i");
+
+    *entry = eh->entry;
+    return 0;
+}
@@ -3,69 +3,26 @@
 void printf(char *fmt, ...);
 void task_init();
 void schedule();
+void task_idle_loop();
 void mm_init();
 void* frame_alloc();
 void frame_dealloc(void *ptr);
+int mm_refill_zero_pool(int max);
 void kvminit();
 void kvminithart();
-extern uint64_t _app_start;
-extern uint64_t _app_end;
+void timer_init();
+void task_start_harts();
+void console_init();
+void plic_init();
+void plic_inithart();
+void uart_init();
+void vdso_init();
+void kmem_init();
+void string_init();
 extern void __alltraps();
-extern void __restore(uint64_t *cx);
 
-
-#define APP_BASE_ADDRESS 0x80400000
-#define APP_SIZE_LIMIT 0x20000  // 假设 App 不超过 128KB
-
-// 分配两个栈
-// Kernel Stack 各种中断处理用
-// User Stack 用户程序用
-uint8_t kernel_stack[4096 * 2];
-uint8_t user_stack[4096 * 2];
-
-typedef struct {
-    uint64_t x[32];
-    uint64_t sstatus;
-    uint64_t sepc;
-} TrapContext;
-
-
-void load_and_run_app(){
-    // 1. 加载 App 代码
-    uint64_t *src = &_app_start;
-    uint64_t *dst = (uint64_t *)APP_BASE_ADDRESS;
-    uint64_t *end = &_app_end;
-    while (src < end) *dst++ = *src++;
-
-    asm volatile("fence.i");
-    
-    printf("[Kernel] App loaded. Preparing to switch to User Mode... \n");
-
-    // 2. 初始化 Trap 向量表
-    // 告诉 CPU 遇到 ecall 去哪里
-    asm volatile("csrw stvec, %0" : : "r"(__alltraps));
-
-    // 3. 构造一个 "伪造" 的 Trap 上下文
-    // 上下文放在 Kernel Stack 的栈顶
-    TrapContext *cx = (TrapContext *) (kernel_stack + sizeof(kernel_stack) - sizeof(TrapContext));
-
-    // 设置 sstatus: 将 SPP 位设为0 User Mode
-    // 1 << 5 是 SPIE 开启中断 这里简单设为 0
-    cx->sstatus = 0;
-
-    // 设置 sepc: 返回后跳转到 App 的入口地址
-    cx->sepc = APP_BASE_ADDRESS;
-
-    // 设置 sp: 用户栈的栈顶
-    cx->x[2] = (uint64_t)(user_stack + sizeof(user_stack));
-
-    // 设置 sscratch: 指向内核栈顶 给trap.S交换用
-    asm volatile("csrw sscratch, %0" : : "r"(kernel_stack + sizeof(kernel_stack)));
-
-    printf("[Kernel] Jumping to User App via __restore!\n");
-
-    __restore((uint64_t *)cx);
-}
+// Phase 3 的 load_and_run_app (把裸二进制拷到固定地址直接 sret) 已经删除：
+// 应用现在是嵌在内核里的 ELF，由 task.c 通过 loader.c 加载
 
 // paging.c 的函数
 typedef uint64_t* pagetable_t;
@@ -73,7 +30,7 @@ void* frame_alloc();
 int mappages(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
 
 
-void main(){
+void main(uint64_t hartid){
     // printf("\n[ToyOS] Phase 3: Privilege Switching\n");
     // load_and_run_app();
     // while(1){};
@@ -165,9 +122,15 @@ void main(){
 
     // while (1) {};
 
+    // 探测 SBI DBCN，之后 printf 整行交给固件输出
+    console_init();
+
     printf("\n[ToyOS] Phase 6: Page Table Mapping\n");
+    printf("[Kernel] Boot hart %d\n", hartid);
 
     asm volatile("csrw stvec, %0"::"r"(__alltraps));
+    // 约定：在内核态时 sscratch 为 0，__alltraps 靠它区分 Trap 来自用户态还是内核态
+    asm volatile("csrw sscratch, zero");
 
     // // 手动写一个非法地址访问
     // printf("[Main] Triggering a trap now ... \n");
@@ -176,8 +139,12 @@ void main(){
     // printf("[Main] Survived trap?(should not see this)\n");
     // 为了调试暂时不执行
     
-    // 初始化物理内存
+    // 选择 memcpy/memset 的实现 (有 V 扩展就用向量版本)，清零页之前就要定下来
+    string_init();
+
+    // 初始化物理内存，再在它上面建 slab 分配器 (小对象)
     mm_init();
+    kmem_init();
 
     // 建立内核页表
     kvminit();
@@ -187,8 +154,36 @@ void main(){
 
     printf("[Kernel] System matches Physical Memory 1:1. \n");
 
+    // 外部中断：PLIC 全局设置 + UART 接收中断 + 本 hart 的 PLIC context
+    plic_init();
+    uart_init();
+    plic_inithart();
+
+    // 每个进程都映射的只读 vDSO 页，要在第一个进程加载之前准备好
+    vdso_init();
+
     task_init();
-    schedule();
-    
-    while (1) {};
-}
\ No newline at end of file
+
+    // 唤醒其他 hart，它们从 secondary_main 进来
+    task_start_harts();
+
+    // 开启时钟中断，之后用户态的死循环也会被抢占
+    timer_init();
+
+    // 进入 idle 路径，由它把任务调度起来
+    task_idle_loop();
+}
+
+// 其他 hart 的 C 入口 (entry.S 的 _secondary_start 已经设好了 sp 和 tp)
+// 内存管理和内核页表由启动 hart 建好，这里只需要本 hart 的 CSR 初始化
+void secondary_main(uint64_t hartid) {
+    asm volatile("csrw sscratch, zero");
+
+    // 开启MMU (stvec 也在这里指向 Trampoline)
+    kvminithart();
+    printf("[Kernel] hart %d online\n", hartid);
+    plic_inithart();
+
+    timer_init();
+    task_idle_loop();
+}
@@ -2,84 +2,349 @@
 
 void printf(char *fmt, ...);
 
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+
 // 引用 kernel.ld 中的符号
 extern char ekernel[];
 
+void trace_event(int type, uint64_t a, uint64_t b);
+int kmem_reap();
+void klog(int level, char *fmt, ...);
+#define LOG_WARN 4
+void clear_page(void *dst);
+#define TR_FRAME_ALLOC 5
+#define TR_FRAME_FREE 6
+
+#define KERNEL_BASE 0x80200000  // 内核加载地址 (kernel.ld 的 BASE_ADDRESS)
 #define MEMORY_END 0x88000000   // 物理内存的末尾
 
 #define PAGE_SIZE 4096      // 物理页大小
 
-// 用一个数组来存空闲页的物理页号
-// 缩小页内存到 512 而不是 32768
-#define MAX_PHYSICAL_PAGES 512
+// --- 伙伴系统 (Buddy Allocator) ---
+// 阶 (order) 为 k 的块包含 2^k 个连续物理页
+// MAX_ORDER = 11 -> 支持 0..10 阶，最大块 4MB，可以切出 2MB 大页
+#define MAX_ORDER 11
 
-uint64_t recycled_pages[MAX_PHYSICAL_PAGES];
-int recycled_ptr = 0;
+// 内核之后到 MEMORY_END 的所有物理页，每页一个描述符
+#define MAX_FRAMES ((MEMORY_END - KERNEL_BASE) / PAGE_SIZE)
 
-uint64_t current_palloc_start = 0;
-uint64_t current_palloc_end = 0;
+typedef struct {
+    uint8_t is_free;    // 1 表示这是一个空闲块的首页
+    uint8_t order;      // 空闲块的阶 (只有 is_free 时有意义)
+    uint16_t refcnt;    // 已分配页的引用计数 (COW 共享时 > 1)
+} PageInfo;
 
-// 初始化内存管理器
-void mm_init() { 
+// 空闲块直接把链表节点存在空闲页自身里 (恒等映射下 PA 可以直接当指针用)
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+    struct FreeBlock *prev;
+} FreeBlock;
 
-    printf("[Kernel] Checking BSS: recycled_ptr=%d (Expect 0)\n", recycled_ptr);
+PageInfo page_info[MAX_FRAMES];
+FreeBlock free_area[MAX_ORDER];     // 每一阶一个带哨兵的双向循环链表
+uint64_t free_blocks[MAX_ORDER];    // 每一阶的空闲块数量
 
-    recycled_ptr = 0;
+uint64_t start_pfn = 0;     // 可分配区间 [start_pfn, end_pfn)
+uint64_t end_pfn = 0;
+uint64_t nr_free_pages = 0;
 
-    // ekernel 是内核代码结束的地方，从这里开始分配
-    current_palloc_start = (uint64_t)ekernel;
+// 伙伴系统、引用计数和清零页池共用一把锁 (多个 hart 会同时分配/释放)
+// 清零整页比较慢，放在锁外面做
+spinlock_t mm_lock;
+
+#define PFN2INFO(pfn) (&page_info[(pfn) - KERNEL_BASE / PAGE_SIZE])
+
+static void list_push(int order, uint64_t pfn) {
+    FreeBlock *head = &free_area[order];
+    FreeBlock *b = (FreeBlock *)(pfn * PAGE_SIZE);
+    b->next = head->next;
+    b->prev = head;
+    head->next->prev = b;
+    head->next = b;
+
+    PageInfo *info = PFN2INFO(pfn);
+    info->is_free = 1;
+    info->order = order;
+    free_blocks[order]++;
+}
+
+static void list_remove(int order, uint64_t pfn) {
+    FreeBlock *b = (FreeBlock *)(pfn * PAGE_SIZE);
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
 
+    PFN2INFO(pfn)->is_free = 0;
+    free_blocks[order]--;
+}
+
+// 初始化内存管理器
+void mm_init() {
+    for (int i = 0; i < MAX_ORDER; i++) {
+        free_area[i].next = &free_area[i];
+        free_area[i].prev = &free_area[i];
+        free_blocks[i] = 0;
+    }
+
+    // ekernel 是内核代码结束的地方，从这里开始分配
     // 向上对齐到 4KB
-    if(current_palloc_start % PAGE_SIZE != 0){
-        current_palloc_start = (current_palloc_start / PAGE_SIZE + 1)* PAGE_SIZE;
+    start_pfn = ((uint64_t)ekernel + PAGE_SIZE - 1) / PAGE_SIZE;
+    end_pfn = MEMORY_END / PAGE_SIZE;
+    nr_free_pages = end_pfn - start_pfn;
+
+    // 把整段内存切成尽可能大的、按自身大小对齐的块放入空闲链表
+    uint64_t pfn = start_pfn;
+    while (pfn < end_pfn) {
+        int order = MAX_ORDER - 1;
+        while (order > 0 && ((pfn & ((1UL << order) - 1)) != 0 || pfn + (1UL << order) > end_pfn)) {
+            order--;
+        }
+        list_push(order, pfn);
+        pfn += 1UL << order;
     }
-    
-    current_palloc_end = MEMORY_END;
 
     printf("[Kernel] Memory Manager Initialized. \n");
     // 打印 内核之后可随意支配的物理内存区间
-    printf("[Kernel] Free RAM start: %x, end: %x \n", current_palloc_start, current_palloc_end);
+    printf("[Kernel] Free RAM start: %lx, end: %lx \n", start_pfn * PAGE_SIZE, end_pfn * PAGE_SIZE);
+    printf("[Kernel] Buddy allocator: %lu free pages\n", nr_free_pages);
 }
 
-// 分配一个物理页，返回物理地址
-void* frame_alloc() {
-    uint64_t ppn = 0;
+// 分配 2^order 个连续物理页，返回起始物理地址 (不清零)
+// 调用者持有 mm_lock
+static void* alloc_pages_locked(int order) {
+    if (order < 0 || order >= MAX_ORDER) return 0;
 
-    // 优先从回收栈里拿
-    if (recycled_ptr > 0) {
-        ppn = recycled_pages[--recycled_ptr];
-    } else {
-        // 如果回收栈是空的，就从未使用的内存中切一块
-        if(current_palloc_start < current_palloc_end){
-            ppn = current_palloc_start / PAGE_SIZE;
-            current_palloc_start += PAGE_SIZE;
-        }else{
-            printf("[Kernel] Out of Memory!\n");
-            return 0;
+    // 找到第一个有空闲块的阶
+    int o = order;
+    while (o < MAX_ORDER && free_area[o].next == &free_area[o]) o++;
+    if (o == MAX_ORDER) return 0;
+
+    uint64_t pfn = (uint64_t)free_area[o].next / PAGE_SIZE;
+    list_remove(o, pfn);
+
+    // 大块一分为二，后一半 (伙伴) 放回低一阶的链表
+    while (o > order) {
+        o--;
+        list_push(o, pfn + (1UL << o));
+    }
+
+    nr_free_pages -= 1UL << order;
+    PFN2INFO(pfn)->refcnt = 1;
+    return (void *)(pfn * PAGE_SIZE);
+}
+
+// 释放 2^order 个连续物理页，并尽可能与伙伴合并
+// 调用者持有 mm_lock
+static void free_pages_locked(void *pa, int order) {
+    uint64_t pfn = (uint64_t)pa / PAGE_SIZE;
+
+    if ((uint64_t)pa % PAGE_SIZE != 0 || pfn < start_pfn || pfn + (1UL << order) > end_pfn) {
+        printf("[Kernel] free_pages: bad address %p\n", pa);
+        return;
+    }
+    if (PFN2INFO(pfn)->is_free) {
+        printf("[Kernel] free_pages: double free %p\n", pa);
+        return;
+    }
+
+    nr_free_pages += 1UL << order;
+    PFN2INFO(pfn)->refcnt = 0;
+
+    while (order < MAX_ORDER - 1) {
+        uint64_t buddy = pfn ^ (1UL << order);
+        if (buddy < start_pfn || buddy + (1UL << order) > end_pfn) break;
+
+        PageInfo *info = PFN2INFO(buddy);
+        if (!info->is_free || info->order != order) break;
+
+        // 伙伴也空闲：摘下来合并成高一阶的块
+        list_remove(order, buddy);
+        if (buddy < pfn) pfn = buddy;
+        order++;
+    }
+    list_push(order, pfn);
+}
+
+// 伙伴系统分不出来时，先让 slab 分配器 (slab.c) 把全空的 slab 还回来，再试一次
+// 调用者不能持有 mm_lock
+static void* alloc_pages_reclaim(int order) {
+    void *pa = 0;
+    if (kmem_reap() > 0) {
+        spin_lock(&mm_lock);
+        pa = alloc_pages_locked(order);
+        spin_unlock(&mm_lock);
+    }
+    if (pa == 0) klog(LOG_WARN, "[Kernel] Out of Memory! (order %d)", order);
+    return pa;
+}
+
+void* alloc_pages(int order) {
+    spin_lock(&mm_lock);
+    void *pa = alloc_pages_locked(order);
+    spin_unlock(&mm_lock);
+    if (pa == 0) pa = alloc_pages_reclaim(order);
+    return pa;
+}
+
+void free_pages(void *pa, int order) {
+    spin_lock(&mm_lock);
+    free_pages_locked(pa, order);
+    spin_unlock(&mm_lock);
+}
+
+// 当前空闲物理页总数
+uint64_t free_page_count() {
+    return nr_free_pages;
+}
+
+// --- 预清零页池 (Zeroed Page Pool) ---
+// 清零一页的开销不应该落在 frame_alloc() 的关键路径上
+// CPU 空转的时候 (idle / 等键盘输入) 提前把页清好，放进池子里
+#define ZERO_POOL_SIZE 64
+
+uint64_t zero_pool[ZERO_POOL_SIZE];
+int zero_pool_cnt = 0;
+
+uint64_t zero_pool_hits = 0;    // frame_alloc() 直接从池子里拿到了页
+uint64_t zero_pool_misses = 0;  // 池子空了，只能现场清零
+
+// 在空闲时调用：最多补充 max 个清零页，返回实际补充的数量
+int mm_refill_zero_pool(int max) {
+    int n = 0;
+    while (n < max) {
+        spin_lock(&mm_lock);
+        // 伙伴系统里没有页了就不要再囤了
+        void *pa = 0;
+        if (zero_pool_cnt < ZERO_POOL_SIZE && nr_free_pages > 0) {
+            pa = alloc_pages_locked(0);
+        }
+        spin_unlock(&mm_lock);
+        if (pa == 0) break;
+
+        clear_page(pa);
+
+        spin_lock(&mm_lock);
+        if (zero_pool_cnt < ZERO_POOL_SIZE) {
+            zero_pool[zero_pool_cnt++] = (uint64_t)pa;
+            pa = 0;
         }
+        spin_unlock(&mm_lock);
+        // 别的 hart 抢先把池子填满了
+        if (pa) {
+            free_pages(pa, 0);
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+// 分配一个物理页，返回物理地址 (内容已清零)
+void* frame_alloc() {
+    spin_lock(&mm_lock);
+    if (zero_pool_cnt > 0) {
+        zero_pool_hits++;
+        void *pa = (void *)zero_pool[--zero_pool_cnt];
+        spin_unlock(&mm_lock);
+        trace_event(TR_FRAME_ALLOC, (uint64_t)pa, 1);
+        return pa;
     }
 
+    zero_pool_misses++;
+    void *pa = alloc_pages_locked(0);
+    spin_unlock(&mm_lock);
+    if (pa == 0) pa = alloc_pages_reclaim(0);
+    if (pa == 0) return 0;
 
     // 先清空这一页内存，防止读到脏数据
-    uint64_t addr = ppn * PAGE_SIZE;
+    clear_page(pa);
+    trace_event(TR_FRAME_ALLOC, (uint64_t)pa, 0);
+    return pa;
+}
 
-    char *mem = (char *) addr;
-    for (int i = 0; i < PAGE_SIZE; i++){
-        mem[i] = 0;
+// 分配一个物理页，但不清零
+// 给马上就会整页覆盖的调用者用 (比如 uvm_copy)
+void* frame_alloc_nozero() {
+    spin_lock(&mm_lock);
+    void *pa = alloc_pages_locked(0);
+    if (pa == 0 && zero_pool_cnt > 0) {
+        // 伙伴系统耗尽时，池子里的页也能用
+        pa = (void *)zero_pool[--zero_pool_cnt];
     }
+    spin_unlock(&mm_lock);
+    if (pa == 0) pa = alloc_pages_reclaim(0);
+    if (pa) trace_event(TR_FRAME_ALLOC, (uint64_t)pa, 0);
+    return pa;
+}
 
-    return (void*) addr;
+// --- 引用计数 ---
+// fork 时父子进程共享同一个物理页 (COW)，最后一个使用者释放时才真正回收
+
+static int frame_managed(uint64_t pa) {
+    uint64_t pfn = pa / PAGE_SIZE;
+    return pfn >= start_pfn && pfn < end_pfn;
+}
+
+// 增加一个物理页的引用
+void frame_ref(void *pa) {
+    if (!frame_managed((uint64_t)pa)) return;
+    spin_lock(&mm_lock);
+    PFN2INFO((uint64_t)pa / PAGE_SIZE)->refcnt++;
+    spin_unlock(&mm_lock);
 }
 
-// 回收一个物理页
+// 查询一个物理页的引用计数
+int frame_refcount(void *pa) {
+    if (!frame_managed((uint64_t)pa)) return 0;
+    return PFN2INFO((uint64_t)pa / PAGE_SIZE)->refcnt;
+}
+
+// 回收一个物理页 (减少一个引用，归零时还给伙伴系统)
 void frame_dealloc(void* ptr){
-    uint64_t addr = (uint64_t)ptr;
-    uint64_t ppn = addr/PAGE_SIZE;
+    if (!frame_managed((uint64_t)ptr)) return;
+    spin_lock(&mm_lock);
+    PageInfo *info = PFN2INFO((uint64_t)ptr / PAGE_SIZE);
+    if (info->refcnt > 1) {
+        info->refcnt--;
+    } else {
+        free_pages_locked(ptr, 0);
+    }
+    int left = info->refcnt;
+    spin_unlock(&mm_lock);
+    // b = 剩余引用数，0 表示真正还给了伙伴系统
+    trace_event(TR_FRAME_FREE, (uint64_t)ptr, left);
+}
 
-    if (recycled_ptr < MAX_PHYSICAL_PAGES){
-        recycled_pages[recycled_ptr++] = ppn;
-    }else {
-        printf("[Kernel] Dealloc error: Recycled pool full!\n");
+// 批量回收：和 frame_dealloc 一样按引用计数处理，但 n 个页只拿一次锁
+// 拆除整个地址空间时用 (几百个页逐个 frame_dealloc 要抢几百次 mm_lock)
+void frame_dealloc_batch(void **pas, int n) {
+    int released = 0;
+    spin_lock(&mm_lock);
+    for (int i = 0; i < n; i++) {
+        if (!frame_managed((uint64_t)pas[i])) continue;
+        PageInfo *info = PFN2INFO((uint64_t)pas[i] / PAGE_SIZE);
+        if (info->refcnt > 1) {
+            info->refcnt--;
+        } else {
+            free_pages_locked(pas[i], 0);
+            released++;
+        }
     }
+    spin_unlock(&mm_lock);
+    // 追踪时整批记一条：a = 批大小, b = 真正还给伙伴系统的页数
+    trace_event(TR_FRAME_FREE, n, released);
+}
+
+// 可用的物理页：伙伴系统里的空闲页 + 清零页池里的页 (泄漏检查用，不受 idle 补池子的影响)
+uint64_t mm_available_pages() {
+    return nr_free_pages + zero_pool_cnt;
 }
 
+// 打印内存统计信息
+void mm_stats() {
+    printf("[Kernel] mm: free pages=%lu, zero pool=%d, hits=%lu, misses=%lu\n",
+           nr_free_pages, zero_pool_cnt, zero_pool_hits, zero_pool_misses);
+}
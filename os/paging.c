@@ -2,11 +2,26 @@
 #include <stdint.h>
 
 void printf(char *fmt, ...);
+void klog(int level, char *fmt, ...);
 void* frame_alloc();
 
+// 日志级别 (和 klog.c 的定义保持一致)；pr_debug 在 LOG_LEVEL < 7 时编译成空语句，make LOG_LEVEL=7 打开
+#define LOG_DEBUG 7
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 6
+#endif
+#if LOG_LEVEL >= LOG_DEBUG
+#define pr_debug(...) klog(LOG_DEBUG, __VA_ARGS__)
+#else
+#define pr_debug(...) do { } while (0)
+#endif
+
 // --- 寄存器操作 ---
 #define SATP_SV39 (8L << 60)
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64_t)pagetable) >> 12))
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK 0xFFFFL
+#define SATP_ASID(satp) (((satp) >> SATP_ASID_SHIFT) & SATP_ASID_MASK)
 
 // --- 标志位 ---
 #define PTE_V (1L << 0)
@@ -14,13 +29,16 @@ void* frame_alloc();
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4)
+#define PTE_G (1L << 5)
 #define PTE_A (1L << 6)
 #define PTE_D (1L << 7)
+#define PTE_COW (1L << 8)   // RSW 软件位：写时复制页
 
 #define PAGE_SIZE 4096
 #define PTE2PPN(pte) (((pte) >> 10) & 0x0FFFFFFFFFFFFFL)
 #define PPN2PTE(ppn) (((ppn) << 10))
 #define PTE2PA(pte) (PTE2PPN(pte) * PAGE_SIZE)
+#define PGROUNDDOWN(a) (((uint64_t)(a)) & ~(uint64_t)(PAGE_SIZE - 1))
 #define PX(level, va) ((((uint64_t)(va)) >> (12 + 9 * (level))) & 0x1FF)
 
 typedef uint64_t* pagetable_t;
@@ -31,51 +49,92 @@ extern char etext[];    // 代码段结束
 extern char erodata[];  // 只读数据结束
 extern char ekernel[];  // 内核结束
 extern char tramp_start[]; // Trap 代码开始
+extern char tramp_end[];   // Trap 代码结束
+extern char __alltraps[];
 
 
 // QEMU 的 UART 物理地址
 #define UART0 0x10000000L
+// PLIC (中断控制器)：4MB 覆盖了优先级、使能和所有 hart 的 claim 寄存器
+#define PLIC 0x0c000000L
+#define PLIC_SIZE 0x400000L
 #define MEMORY_END 0x88000000L
 
+// --- 地址空间布局 (SV39) ---
+// 根页表的 512 个槽位，每个管 1GB：
+//   槽位 0..1   [0, 2GB)              用户空间，每个进程私有的页表子树
+//   槽位 2      [2GB, 3GB)            内核：物理内存恒等映射 (0x80000000 开始)
+//   槽位 255    [MAXVA-1GB, MAXVA)    内核：设备 MMIO 窗口 + 最高处的 Trampoline
+// 内核的映射全部带 PTE_G，只在启动时建立一次；
+// 创建进程时只需要把这几个内核槽位链接进新的根页表
+#define MAXVA (1L << 38)
+#define USER_TOP 0x80000000L
+#define KERNEL_ROOT_SLOT_START PX(2, USER_TOP)
+#define TRAMPOLINE (MAXVA - PAGE_SIZE)
+#define KERNEL_MMIO_BASE (MAXVA - (1L << 30))
+#define MMIO_VA(pa) (KERNEL_MMIO_BASE + (pa))
+
 // --- 核心函数 (保留之前的 walk 和 mappages) ---
 
-uint64_t* walk(pagetable_t pagetable, uint64_t va, int alloc) {
-    for (int level = 2; level > 0; level--) {
+// 每一级叶子映射的大小：0 级 4KB，1 级 2MB (大页)，2 级 1GB (巨页)
+#define LEVEL_SIZE(level) (1UL << (12 + 9 * (level)))
+// 叶子 PTE：R/W/X 至少有一位
+#define PTE_LEAF(pte) ((pte) & (PTE_R | PTE_W | PTE_X))
+
+uint64_t pt_frames = 0;     // walk() 为中间页表分配的物理页数
+
+// 走到第 target 级的 PTE
+// 路上如果遇到大页/巨页叶子，直接返回那个叶子 (查询时也能找到大页映射)
+uint64_t* walk_level(pagetable_t pagetable, uint64_t va, int alloc, int target) {
+    for (int level = 2; level > target; level--) {
         int idx = PX(level, va);
         uint64_t pte = pagetable[idx];
         if (pte & PTE_V) {
+            if (PTE_LEAF(pte)) {
+                // 已经被大页覆盖，不能再往下拆
+                return alloc ? 0 : &pagetable[idx];
+            }
             pagetable = (pagetable_t)PTE2PA(pte);
         } else {
             if (!alloc) return 0;
             pagetable_t new_page = (pagetable_t)frame_alloc();
             if (new_page == 0) return 0;
+            pt_frames++;
             pagetable[idx] = PPN2PTE((uint64_t)new_page / PAGE_SIZE) | PTE_V;
             pagetable = new_page;
         }
     }
-    return &pagetable[PX(0, va)];
+    return &pagetable[PX(target, va)];
+}
+
+uint64_t* walk(pagetable_t pagetable, uint64_t va, int alloc) {
+    return walk_level(pagetable, va, alloc, 0);
 }
 
+// 映射 [va, va + size) 覆盖到的所有页
+// va 和 pa 同时按 1GB/2MB 对齐、且剩余长度足够时，直接写巨页/大页叶子
 int mappages(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm) {
-    uint64_t start = va;
-    uint64_t end = va + size;
-    uint64_t offset = pa - start;
+    if (size == 0) return 0;
+    uint64_t start = PGROUNDDOWN(va);
+    uint64_t end = PGROUNDDOWN(va + size - 1) + PAGE_SIZE;
+    uint64_t offset = pa - va;
 
-    for (uint64_t a = start; a <= end; a += PAGE_SIZE) {
-        uint64_t *pte = walk(pagetable, a, 1);
-        if (pte == 0) return -1;
-        
-        // 🔴 如果是 Map Text 阶段，打印一下当前进度
-        // 这样我们知道是在第几页崩的
-        if (va == (uint64_t)stext) {
-             // 减少打印频率，只打印每 4KB
-             printf("Mapping VA %x\n", a);
+    for (uint64_t a = start; a < end; ) {
+        int level = 0;
+        for (int l = 2; l > 0; l--) {
+            uint64_t sz = LEVEL_SIZE(l);
+            if (a % sz == 0 && (a + offset) % sz == 0 && end - a >= sz) {
+                level = l;
+                break;
+            }
         }
 
-        if (*pte & PTE_V) {
-            // printf("Remap warning: %x\n", a);
-        }
+        uint64_t *pte = walk_level(pagetable, a, 1, level);
+        if (pte == 0) return -1;
+
+        if (*pte & PTE_V) pr_debug("[Kernel] mappages: remap %p", a);
         *pte = PPN2PTE((a + offset) / PAGE_SIZE) | perm | PTE_V | PTE_A | PTE_D;
+        a += LEVEL_SIZE(level);
     }
     return 0;
 }
@@ -83,12 +142,17 @@ int mappages(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int
 // 创建用户页表
 // 分配根页表
 // 映射 Trap入口  所有进程都必须有，否则无法进入内核
+extern pagetable_t kernel_pagetable;
+
 pagetable_t uvm_create(){
     pagetable_t pagetable = (pagetable_t) frame_alloc();
     if(pagetable == 0) return 0;
 
-    // 映射 Trampoline 到虚拟地址最高处 (与内核页表保持一致)
-    // TODO: 先返回空页表
+    // 链接内核的共享子树 (物理内存、MMIO、Trampoline)
+    // 用户槽位保持为空，用户映射会建在进程自己的页表里
+    for (int i = KERNEL_ROOT_SLOT_START; i < 512; i++) {
+        pagetable[i] = kernel_pagetable[i];
+    }
     return pagetable;
 }
 
@@ -97,112 +161,291 @@ pagetable_t uvm_create(){
 // pa: 物理地址
 // size: 大小
 // perm: 权限 (比如 PTE_R | PTE_W | PTE_U)
-void uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm) {
-    if (mappages(pagetable, va, pa, size, perm | PTE_U) != 0) {
-        printf("[Kernel] uvm_map failed!\n");
-        while(1);
+// 成功返回 0；中间页表分配不到内存时返回 -1，pa 的引用还是调用者的，由调用者释放
+// (缺页、fork 都会走到这里，内存不够只能让这次操作失败，不能把整个内核停住)
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm) {
+    // 用户映射只能落在用户槽位里，不能碰到共享的内核子树
+    if (va >= USER_TOP || size > USER_TOP - va) {
+        printf("[Kernel] uvm_map: va %p out of user space!\n", va);
+        return -1;
     }
+    return mappages(pagetable, va, pa, size, perm | PTE_U);
 }
 
 // 内核页表指针
 pagetable_t kernel_pagetable;
 
+static inline uint64_t r_time() {
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
 // 创建内核页表
+// 权限不变的大段区域 (数据 + 剩余物理内存) 由 mappages 自动用 2MB 大页映射
+// 只有权限边界附近 (text/rodata/data 交界、UART) 才用 4KB 小页
 void kvminit() {
+    uint64_t t0 = r_time();
+    pt_frames = 0;
+
     kernel_pagetable = (pagetable_t)frame_alloc();
+    pt_frames++;
 
     // printf("[Kernel] Kernel PT created at %x\n", kernel_pagetable);
-    printf("[Kernel] stext=%x, etext=%x\n", (uint64_t)stext, (uint64_t)etext);
-    printf("[Kernel] Text Size=%x\n", (uint64_t)etext - (uint64_t)stext);
+    printf("[Kernel] stext=%p, etext=%p\n", stext, etext);
+    printf("[Kernel] Text Size=%lx\n", (uint64_t)etext - (uint64_t)stext);
 
-    // 1. 映射 UART 
+    // 1. 映射 UART 到高处的 MMIO 窗口
     // 权限: R | W
-    mappages(kernel_pagetable, UART0, UART0, PAGE_SIZE, PTE_R | PTE_W);
-    printf("[Kernel] Map UART... done.\n");
+    mappages(kernel_pagetable, MMIO_VA(UART0), UART0, PAGE_SIZE, PTE_R | PTE_W | PTE_G);
+    pr_debug("[Kernel] Map UART... done.");
+
+    // PLIC 也放进 MMIO 窗口，起始地址 2MB 对齐，mappages 会用大页
+    mappages(kernel_pagetable, MMIO_VA(PLIC), PLIC, PLIC_SIZE, PTE_R | PTE_W | PTE_G);
+    pr_debug("[Kernel] Map PLIC... done.");
 
     // 2. 映射内核代码段 (.text)
     // 权限: R | X
-    // mappages(kernel_pagetable, (uint64_t)stext, (uint64_t)stext, 
-    //          (uint64_t)etext - (uint64_t)stext, PTE_R | PTE_X);
-    // printf("[Kernel] Map Text... done.\n");
-    printf("[Kernel] Start mapping Text...\n");
     mappages(kernel_pagetable, (uint64_t)stext, (uint64_t)stext, 
-             (uint64_t)etext - (uint64_t)stext, PTE_R | PTE_X);
-    printf("[Kernel] Map Text... done.\n");
+             (uint64_t)etext - (uint64_t)stext, PTE_R | PTE_X | PTE_G);
+    pr_debug("[Kernel] Map Text... done.");
 
     // 3. 映射只读数据段 (.rodata)
     // 权限: R
     mappages(kernel_pagetable, (uint64_t)etext, (uint64_t)etext, 
-             (uint64_t)erodata - (uint64_t)etext, PTE_R);
-    printf("[Kernel] Map Rodata... done.\n");
+             (uint64_t)erodata - (uint64_t)etext, PTE_R | PTE_G);
+    pr_debug("[Kernel] Map Rodata... done.");
 
     // 4. 映射数据段 + BSS + 剩余物理内存 (.data ~ MEMORY_END)
     // 权限: R | W
     mappages(kernel_pagetable, (uint64_t)erodata, (uint64_t)erodata, 
-             (uint64_t)MEMORY_END - (uint64_t)erodata, PTE_R | PTE_W);
-    printf("[Kernel] Map Data/BSS/Heap... done.\n");
+             (uint64_t)MEMORY_END - (uint64_t)erodata, PTE_R | PTE_W | PTE_G);
+    pr_debug("[Kernel] Map Data/BSS/Heap... done.");
     
     // 5. 映射 Trampoline (Trap 入口)
     // 把它映射到虚拟地址最高处 (uCore 惯例)，也为了和内核其他部分分开
-    // 暂时我们也做 1:1 映射，为了简单
-    // mappages(kernel_pagetable, (uint64_t)tramp_start, (uint64_t)tramp_start, PAGE_SIZE, PTE_R | PTE_X);
+    // 每个进程都链接了这个槽位，stvec 指向这里
+    mappages(kernel_pagetable, TRAMPOLINE, (uint64_t)tramp_start,
+             (uint64_t)tramp_end - (uint64_t)tramp_start, PTE_R | PTE_X | PTE_G);
+    pr_debug("[Kernel] Map Trampoline... done.");
+
+    printf("[Kernel] Kernel page table: %lu frames, built in %lu ticks\n",
+           pt_frames, r_time() - t0);
 }
 
+// 硬件实际支持的 ASID 位数 (0 表示不支持 ASID，切换时只能全刷 TLB)
+int asid_bits = 0;
+
 // 开启分页
 void kvminithart() {
     // 写入 satp 寄存器
     // Mode = 8 (SV39), PPN = kernel_pagetable
     uint64_t satp_val = MAKE_SATP(kernel_pagetable);
+
+    // 探测 ASID 位数：ASID 字段是 WARL 的，写全 1 再读回来，没实现的位会读成 0
+    uint64_t probe = satp_val | (SATP_ASID_MASK << SATP_ASID_SHIFT);
+    asm volatile("csrw satp, %0" : : "r" (probe));
+    asm volatile("csrr %0, satp" : "=r" (probe));
+    uint64_t asid_field = SATP_ASID(probe);
+    asid_bits = 0;
+    while (asid_field & 1) {
+        asid_bits++;
+        asid_field >>= 1;
+    }
     
-    // 写入寄存器
+    // 写入寄存器 (内核页表使用 ASID 0)
     asm volatile("csrw satp, %0" : : "r" (satp_val));
     
     // 刷新 TLB (快表)
     asm volatile("sfence.vma zero, zero");
     
+    // 允许用户态直接读 cycle / time / instret 计数器 (跑分程序用 rdtime)
+    asm volatile("csrw scounteren, %0" : : "r"(7));
+
+    // Trap 入口改用高处的 Trampoline 别名
+    uint64_t stvec = TRAMPOLINE + ((uint64_t)__alltraps - (uint64_t)tramp_start);
+    asm volatile("csrw stvec, %0" : : "r"(stvec));
+
     printf("[Kernel] Paging ENABLED! Hello from Virtual World!\n");
+    printf("[Kernel] ASID bits supported: %d\n", asid_bits);
 }
 
+void task_tlb_changed();
 
-void* frame_alloc();
-void uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+// 刷新当前地址空间 (当前 satp 的 ASID) 的 TLB 表项
+// va 为 0 时刷新整个 ASID，否则只刷新这一页
+// ASID 为 0 (硬件不支持 ASID，所有地址空间共用 0) 时 rs2 必须是 x0 本身才会刷新所有 ASID；
+// 放一个值为 0 的寄存器只刷 ASID 0 的非全局表项，所以这种情况单独写成 zero
+// 其他 hart 不发 IPI 去刷：只给任务打上 tlb_stale 标记，
+// 等它下次在那些 hart 上被调度时再刷 (见 task.c 的 switch_satp)
+static void flush_current_asid(uint64_t va) {
+    task_tlb_changed();
 
-// 简单的内存复制
-void my_memcpy_paging(void *dst, void *src, uint64_t len) {
-    char *d = dst; char *s = src;
-    while(len--) *d++ = *s++;
+    uint64_t satp;
+    asm volatile("csrr %0, satp" : "=r"(satp));
+    uint64_t asid = SATP_ASID(satp);
+    if (asid == 0) {
+        if (va == 0) asm volatile("sfence.vma zero, zero");
+        else asm volatile("sfence.vma %0, zero" : : "r"(va));
+    } else if (va == 0) {
+        asm volatile("sfence.vma zero, %0" : : "r"(asid));
+    } else {
+        asm volatile("sfence.vma %0, %1" : : "r"(va), "r"(asid));
+    }
 }
 
-// 从父页表复制内存给子页表
+
+void* frame_alloc_nozero();
+void frame_ref(void *pa);
+int frame_refcount(void *pa);
+void frame_dealloc(void *pa);
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+
+void copy_page(void *dst, const void *src);
+
+// 注意：用户进程都是单线程的，一张用户页表只会被正在运行它的那个 hart 修改，
+// 所以 uvm_copy / uvm_cow_fault 不需要额外的页表锁；
+// 物理页的分配和引用计数由 mm.c 的 mm_lock 保护
+
+// 从父页表复制地址空间给子页表 (写时复制)
 // old_pt: 父进程页表
 // new_pt: 子进程页表
-// start/sz: 用户空间范围 (0 ~ 0xXXXXX)
-int uvm_copy(pagetable_t old_pt, pagetable_t new_pt, uint64_t sz) {
-    uint64_t start = 0;
-    
-    // 遍历用户空间的每一页
-    for (uint64_t va = start; va < sz; va += PAGE_SIZE) {
-        // 1. 在父页表中找到 PTE
-        uint64_t *old_pte = walk(old_pt, va, 0);
-        if (!old_pte || !(*old_pte & PTE_V)) {
-            continue; // 如果父进程没用这页，跳过
+// 只沿着父页表里有效的表项走 (用户槽位 0..1)，空洞直接跳过，
+// 所以不管程序多大、栈放在多高，都不需要知道用户空间的范围
+// 不再拷贝数据，父子共享同一物理页：
+// 可写页在两边都降级为只读并打上 PTE_COW，等真正写的时候再复制
+int uvm_copy(pagetable_t old_pt, pagetable_t new_pt) {
+    for (int i2 = 0; i2 < KERNEL_ROOT_SLOT_START; i2++) {
+        if (!(old_pt[i2] & PTE_V)) continue;
+        pagetable_t l1 = (pagetable_t)PTE2PA(old_pt[i2]);
+
+        for (int i1 = 0; i1 < 512; i1++) {
+            if (!(l1[i1] & PTE_V)) continue;
+            pagetable_t l0 = (pagetable_t)PTE2PA(l1[i1]);
+
+            for (int i0 = 0; i0 < 512; i0++) {
+                // 1. 父进程没用这页，跳过
+                uint64_t *old_pte = &l0[i0];
+                if (!(*old_pte & PTE_V)) continue;
+
+                uint64_t va = ((uint64_t)i2 << 30) | ((uint64_t)i1 << 21) | ((uint64_t)i0 << 12);
+
+                // 2. 获取父进程这页的物理地址
+                uint64_t pa = PTE2PA(*old_pte);
+                // 获取权限 (低 10 位: V/R/W/X/U/A/D 和 RSW)
+                int flags = (*old_pte) & 0x3FF;
+
+                // 3. 可写页改成只读 + COW，父进程的 PTE 也一起降级
+                if (flags & (PTE_W | PTE_COW)) {
+                    flags = (flags & ~PTE_W) | PTE_COW;
+                    *old_pte = PPN2PTE(pa / PAGE_SIZE) | flags;
+                }
+
+                // 4. 子进程共享这一物理页
+                frame_ref((void *)pa);
+
+                // 5. 在子进程页表中建立映射
+                // 注意：flags 包含了 PTE_U 等标志
+                // 失败时已经复制的映射留在子进程页表里，由调用者整张释放
+                if (uvm_map(new_pt, va, pa, PAGE_SIZE, flags) != 0) {
+                    frame_dealloc((void *)pa);
+                    flush_current_asid(0);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // 父进程的 PTE 被改成只读了，TLB 里可能还缓存着可写的旧表项
+    // uvm_copy 在父进程上下文中执行，只需刷新父进程自己的 ASID
+    flush_current_asid(0);
+    return 0;
+}
+
+// 解除当前地址空间里从 va 开始的 npages 个页的映射，并释放对应的物理页 (按引用计数)
+// 没映射的页跳过；结束后刷新当前 ASID
+void uvm_unmap(pagetable_t pagetable, uint64_t va, uint64_t npages) {
+    for (uint64_t i = 0; i < npages; i++, va += PAGE_SIZE) {
+        uint64_t *pte = walk(pagetable, va, 0);
+        if (pte == 0 || !(*pte & PTE_V)) continue;
+        uint64_t pa = PTE2PA(*pte);
+        *pte = 0;
+        frame_dealloc((void *)pa);
+    }
+    flush_current_asid(0);
+}
+
+// --- 地址空间拆除 ---
+// 要释放的页先攒起来，满 FREE_BATCH 个才交给 mm.c 一次 (一次拿锁)
+#define FREE_BATCH 64
+
+typedef struct {
+    void *pa[FREE_BATCH];
+    int n;
+} FreeBatch;
+
+void frame_dealloc_batch(void **pas, int n);
+
+static void batch_add(FreeBatch *b, void *pa) {
+    b->pa[b->n++] = pa;
+    if (b->n == FREE_BATCH) {
+        frame_dealloc_batch(b->pa, b->n);
+        b->n = 0;
+    }
+}
+
+// 递归释放一棵用户子树：非叶子表项指向下一级页表，叶子指向用户页 (按引用计数释放)
+// 用户空间只用 4KB 页，叶子只会出现在第 0 级
+static void free_subtree(pagetable_t pt, int level, FreeBatch *b) {
+    for (int i = 0; i < 512; i++) {
+        uint64_t pte = pt[i];
+        if (!(pte & PTE_V)) continue;
+        if ((pte & (PTE_R | PTE_W | PTE_X)) == 0) {
+            free_subtree((pagetable_t)PTE2PA(pte), level - 1, b);
+        } else if (level == 0) {
+            batch_add(b, (void *)PTE2PA(pte));
+        } else {
+            printf("[Kernel] uvm_free: unexpected huge page at level %d\n", level);
         }
-        
-        // 2. 获取父进程这页的物理地址
-        uint64_t pa = PTE2PA(*old_pte);
-        // 获取权限 (屏蔽掉 R/W/X 以外的位，比如 A/D)
-        int flags = (*old_pte) & 0x3FF; 
-
-        // 3. 为子进程分配一个新的物理页
-        void *new_pa = frame_alloc();
-        if (new_pa == 0) return -1; // 内存不足
-        
-        // 4. 【关键】把父进程的数据拷贝到新页
-        my_memcpy_paging(new_pa, (void*)pa, PAGE_SIZE);
-        
-        // 5. 在子进程页表中建立映射
-        // 注意：flags 包含了 PTE_U 等标志
-        uvm_map(new_pt, va, (uint64_t)new_pa, PAGE_SIZE, flags);
     }
+    batch_add(b, pt);
+}
+
+// 释放一个用户地址空间：用户页 (按引用计数)、用户部分的页表页和根页表
+// 内核槽位是共享的子树，只断开不释放
+// 调用者保证这张页表已经不在任何 hart 的 satp 里
+void uvm_free(pagetable_t pagetable) {
+    FreeBatch b;
+    b.n = 0;
+    for (int i2 = 0; i2 < KERNEL_ROOT_SLOT_START; i2++) {
+        if (pagetable[i2] & PTE_V) free_subtree((pagetable_t)PTE2PA(pagetable[i2]), 1, &b);
+    }
+    batch_add(&b, pagetable);
+    if (b.n) frame_dealloc_batch(b.pa, b.n);
+}
+
+// 处理写时复制缺页
+// 返回 0 表示已处理 (可以重新执行出错的指令)，-1 表示不是 COW 缺页
+int uvm_cow_fault(pagetable_t pagetable, uint64_t va) {
+    va = PGROUNDDOWN(va);
+    uint64_t *pte = walk(pagetable, va, 0);
+    if (pte == 0) return -1;
+    if ((*pte & (PTE_V | PTE_U | PTE_COW)) != (PTE_V | PTE_U | PTE_COW)) return -1;
+
+    uint64_t pa = PTE2PA(*pte);
+    int flags = ((*pte) & 0x3FF & ~PTE_COW) | PTE_W | PTE_D;
+
+    if (frame_refcount((void *)pa) == 1) {
+        // 其他进程都已经放弃了这一页，直接恢复可写
+        *pte = PPN2PTE(pa / PAGE_SIZE) | flags;
+    } else {
+        void *new_pa = frame_alloc_nozero();
+        if (new_pa == 0) return -1;
+        copy_page(new_pa, (void *)pa);
+        *pte = PPN2PTE((uint64_t)new_pa / PAGE_SIZE) | flags;
+        frame_dealloc((void *)pa);
+    }
+
+    flush_current_asid(va);
     return 0;
-}
\ No newline at end of file
+}
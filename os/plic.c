@@ -0,0 +1,51 @@
+// os/plic.c
+// PLIC (Platform-Level Interrupt Controller)：把外设中断送到各个 hart 的 S 态
+#include <stdint.h>
+
+int cpuid();
+
+#define PLIC 0x0c000000L
+#define MAXVA (1L << 38)
+#define KERNEL_MMIO_BASE (MAXVA - (1L << 30))
+#define MMIO_VA(pa) (KERNEL_MMIO_BASE + (pa))
+
+// QEMU virt 上 UART0 的中断号
+#define UART0_IRQ 10
+
+// 寄存器布局 (每个 hart 有 M 态、S 态两个 context，S 态是 2*hart+1)
+#define PLIC_PRIORITY(irq)   (MMIO_VA(PLIC) + (irq) * 4)
+#define PLIC_SENABLE(hart)   (MMIO_VA(PLIC) + 0x2080 + (hart) * 0x100)
+#define PLIC_STHRESHOLD(hart) (MMIO_VA(PLIC) + 0x201000 + (hart) * 0x2000)
+#define PLIC_SCLAIM(hart)    (MMIO_VA(PLIC) + 0x201004 + (hart) * 0x2000)
+
+#define SIE_SEIE (1L << 9)
+
+#define REG32(addr) (*(volatile uint32_t *)(addr))
+
+// 全局设置：给要用的中断源一个非 0 优先级 (0 表示屏蔽)
+void plic_init() {
+    REG32(PLIC_PRIORITY(UART0_IRQ)) = 1;
+}
+
+// 每个 hart 各自调用：打开本 hart S 态 context 的中断源，并打开 sie.SEIE
+// 所有 hart 都能收 UART 中断，谁先 claim 到谁处理
+void plic_inithart() {
+    int hart = cpuid();
+    REG32(PLIC_SENABLE(hart)) = 1 << UART0_IRQ;
+    REG32(PLIC_STHRESHOLD(hart)) = 0;
+
+    uint64_t sie;
+    asm volatile("csrr %0, sie" : "=r"(sie));
+    sie |= SIE_SEIE;
+    asm volatile("csrw sie, %0" : : "r"(sie));
+}
+
+// 领取一个待处理的中断，返回中断号 (0 表示没有)
+int plic_claim() {
+    return REG32(PLIC_SCLAIM(cpuid()));
+}
+
+// 通知 PLIC 这个中断处理完了
+void plic_complete(int irq) {
+    REG32(PLIC_SCLAIM(cpuid())) = irq;
+}
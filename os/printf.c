@@ -1,49 +1,99 @@
-// 依赖 console_putchar 函数输出字符
+// 输出先攒进 console.c 的缓冲区，一条 printf 结束时整段写出
 // Log 打印
+// 格式：%[0][宽度][l]d/u/x，%p，%s，%c，%%
+//   不带 l 的 %d/%u/%x 按 32 位 int 取参数；64 位的值 (地址、计数器) 用 %ld/%lu/%lx 或 %p
+// 同一套格式化也用于内核日志环 (klog.c)，只是输出的目的地不同
 #include <stdarg.h>
+#include <stdint.h>
 
-void console_putchar(int c);
+void console_putc(int c);
+void console_begin();
+void console_end();
+void klog_drain();
 
-void printstr(char *s) {
-    while (*s) console_putchar(*s++);
+typedef void (*putc_fn)(int c);
+
+void printstr(putc_fn out, char *s) {
+    if (s == 0) s = "(null)";
+    while (*s) out(*s++);
 }
 
-void printint(int xx, int base, int sign) {
+void printint(putc_fn out, uint64_t x, int base, int neg, int width, int zero) {
     static char digits[] = "0123456789abcdef";
-    char buf[16];
-    int i;
-    unsigned int x;
-
-    if (sign && (sign = xx < 0)) x = -xx;
-    else x = xx;
+    char buf[24];
+    int i = 0;
 
-    i = 0;
     do {
         buf[i++] = digits[x % base];
     } while ((x /= base) != 0);
 
-    if (sign) buf[i++] = '-';
-
-    while (--i >= 0) console_putchar(buf[i]);
+    if (neg) {
+        // 补 0 时负号在 0 前面
+        if (zero) out('-');
+        else buf[i++] = '-';
+        width--;
+    }
+    while (width-- > i) out(zero ? '0' : ' ');
+    while (--i >= 0) out(buf[i]);
 }
 
-void printf(char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
+void vprintfmt(putc_fn out, char *fmt, va_list ap) {
     for (int i = 0; fmt[i]; i++) {
         char c = fmt[i];
-        if (c == '%') {
+        if (c != '%') {
+            out(c);
+            continue;
+        }
+
+        int zero = 0, width = 0, is_long = 0;
+        c = fmt[++i];
+        if (c == '0') {
+            zero = 1;
             c = fmt[++i];
-            switch (c) {
-            case 'd': printint(va_arg(ap, int), 10, 1); break;
-            case 'x': printint(va_arg(ap, int), 16, 0); break;
-            case 's': printstr(va_arg(ap, char*)); break;
-            case '%': console_putchar('%'); break;
-            default: console_putchar(c);
-            }
-        } else {
-            console_putchar(c);
+        }
+        while (c >= '0' && c <= '9') {
+            width = width * 10 + (c - '0');
+            c = fmt[++i];
+        }
+        if (c == 'l') {
+            is_long = 1;
+            c = fmt[++i];
+        }
+
+        switch (c) {
+        case 'd': {
+            int64_t v = is_long ? va_arg(ap, int64_t) : va_arg(ap, int);
+            printint(out, v < 0 ? -(uint64_t)v : (uint64_t)v, 10, v < 0, width, zero);
+            break;
+        }
+        case 'u':
+            printint(out, is_long ? va_arg(ap, uint64_t) : va_arg(ap, unsigned int), 10, 0, width, zero);
+            break;
+        case 'x':
+            printint(out, is_long ? va_arg(ap, uint64_t) : va_arg(ap, unsigned int), 16, 0, width, zero);
+            break;
+        case 'p':
+            out('0');
+            out('x');
+            printint(out, (uint64_t)va_arg(ap, void *), 16, 0, width, zero);
+            break;
+        case 's': printstr(out, va_arg(ap, char*)); break;
+        case 'c': out(va_arg(ap, int)); break;
+        case '%': out('%'); break;
+        case 0: return;
+        default: out(c);
         }
     }
+}
+
+void printf(char *fmt, ...) {
+    // 先把日志环里还没输出的写出去，控制台上的先后顺序才对
+    klog_drain();
+
+    va_list ap;
+    va_start(ap, fmt);
+    console_begin();
+    vprintfmt(console_putc, fmt, ap);
+    console_end();
     va_end(ap);
-}
\ No newline at end of file
+}
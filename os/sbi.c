@@ -18,6 +18,90 @@ inline uint64 sbi_call(uint64 which, uint64 arg0, uint64 arg1, uint64 arg2) {
     return a0;
 }
 
+// 新版 SBI 调用：a7 = 扩展号 (EID)，a6 = 功能号 (FID)
+// 返回 a0 = 错误码 (0 表示成功)，a1 = 返回值
+typedef struct {
+    long error;
+    long value;
+} SbiRet;
+
+SbiRet sbi_ecall(uint64 ext, uint64 fid, uint64 arg0, uint64 arg1, uint64 arg2) {
+    register uint64 a0 asm("a0") = arg0;
+    register uint64 a1 asm("a1") = arg1;
+    register uint64 a2 asm("a2") = arg2;
+    register uint64 a6 asm("a6") = fid;
+    register uint64 a7 asm("a7") = ext;
+
+    asm volatile("ecall"
+                 : "+r"(a0), "+r"(a1)
+                 : "r"(a2), "r"(a6), "r"(a7)
+                 : "memory");
+    SbiRet ret = {(long)a0, (long)a1};
+    return ret;
+}
+
+// Base 扩展：查询 SBI 实现支持哪些扩展
+#define SBI_EXT_BASE 0x10
+#define SBI_BASE_PROBE_EXTENSION 3
+
+// 返回非 0 表示固件实现了扩展 ext
+long sbi_probe_extension(uint64 ext) {
+    SbiRet ret = sbi_ecall(SBI_EXT_BASE, SBI_BASE_PROBE_EXTENSION, ext, 0, 0);
+    if (ret.error != 0) return 0;
+    return ret.value;
+}
+
+// DBCN (Debug Console) 扩展：一次 ecall 输出一整段缓冲区
+#define SBI_EXT_DBCN 0x4442434E
+#define SBI_DBCN_CONSOLE_WRITE 0
+
+// 输出物理地址 pa 处的 len 个字节
+// 返回实际写出的字节数 (可能少于 len)，出错返回负的错误码
+long sbi_debug_console_write(uint64 pa, uint64 len) {
+    // 参数是 (字节数, 物理地址低 64 位, 物理地址高 64 位)
+    SbiRet ret = sbi_ecall(SBI_EXT_DBCN, SBI_DBCN_CONSOLE_WRITE, len, pa, 0);
+    if (ret.error != 0) return ret.error;
+    return ret.value;
+}
+
+int sbi_has_dbcn() {
+    return sbi_probe_extension(SBI_EXT_DBCN) != 0;
+}
+
+// HSM (Hart State Management) 扩展
+#define SBI_EXT_HSM 0x48534D
+
+// 启动一个处于 STOPPED 状态的 hart，让它从 start_addr (物理地址) 开始执行
+// 进入时 a0 = hartid, a1 = opaque，MMU 关闭
+long sbi_hart_start(uint64 hartid, uint64 start_addr, uint64 opaque) {
+    return sbi_ecall(SBI_EXT_HSM, 0, hartid, start_addr, opaque).error;
+}
+
+// IPI 扩展：给其他 hart 发核间中断，对方 sip.SSIP 置位 (S 态软件中断)
+#define SBI_EXT_IPI 0x735049
+
+// hart_mask 的第 i 位对应 hartid i
+long sbi_send_ipi(uint64 hart_mask) {
+    return sbi_ecall(SBI_EXT_IPI, 0, hart_mask, 0, 0).error;
+}
+
+// SRST (System Reset) 扩展：关机 / 重启
+#define SBI_EXT_SRST 0x53525354
+#define SBI_SRST_SHUTDOWN 0
+
+// 关机，QEMU 会直接退出；固件不支持 SRST 时退回 Legacy 的 shutdown (8)
+void sbi_shutdown() {
+    sbi_ecall(SBI_EXT_SRST, 0, SBI_SRST_SHUTDOWN, 0, 0);
+    sbi_call(8, 0, 0, 0);
+    while (1) ;
+}
+
+// 设置下一次时钟中断的时间 (mtime 达到 stime_value 时触发 S 态时钟中断)
+void sbi_set_timer(uint64 stime_value) {
+    // 0 代表 Legacy SBI 的 Set Timer 扩展
+    sbi_call(0, stime_value, 0, 0);
+}
+
 // 输出单个字符
 void console_putchar(int c) {
     // 1 代表 Legacy SBI 的 Console Putchar 扩展
@@ -0,0 +1,279 @@
+// os/slab.c
+// Slab 分配器：在伙伴系统 (mm.c) 之上分配小于一页的内核对象
+// 每种对象一个 cache，cache 从伙伴系统一次要一页 (一个 slab)，切成等大的对象
+//   - 专用 cache：TCB、VMA (task.c 创建)，同类对象挤在一起，TCB 不再独占两页
+//   - kmalloc：16..2048 字节的几档通用 cache
+// 构造函数只在 slab 新建时对每个对象调用一次，对象释放回 cache 时保持"构造好"的状态，
+// 下次分配直接复用 (比如 TCB 的内核栈)；slab 还给伙伴系统前对每个对象调用析构函数
+//
+// slab 的布局：页首是 Slab 头 (占一个 cache line)，后面是对象
+// 空闲对象串成链表，链接指针放在对象的最后 8 字节，不会碰到构造函数设置的字段
+// (所以构造好的字段不要放在对象的最后 8 字节)
+// 释放时按页对齐就能找到 Slab 头，不需要额外的查找
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void* alloc_pages(int order);
+void free_pages(void *pa, int order);
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+
+#define PAGE_SIZE 4096
+#define CACHE_LINE 64
+#define SLAB_HEADER CACHE_LINE
+
+struct KmemCache;
+
+typedef struct Slab {
+    struct KmemCache *cache;
+    struct Slab *next;
+    struct Slab *prev;
+    void *free;                 // 空闲对象链表
+    int inuse;                  // 已分配出去的对象数
+} Slab;
+
+typedef struct KmemCache {
+    char *name;
+    uint64_t size;              // 对象大小 (已对齐)
+    int per_slab;               // 每个 slab 的对象数
+    int (*ctor)(void *obj);     // 返回非 0 表示构造失败 (比如内存不够)
+    void (*dtor)(void *obj);
+    spinlock_t lock;
+    Slab *partial;              // 还有空闲对象的 slab (包括全空的)
+    Slab *full;                 // 对象全部分配出去的 slab
+    int nr_slabs;
+    int nr_empty;               // 全空的 slab 数，最多留 SLAB_KEEP_EMPTY 个
+    uint64_t nr_inuse;
+    uint64_t nr_allocs;
+    uint64_t nr_frees;
+} KmemCache;
+
+// 每个 cache 最多留着几个全空的 slab 不还 (避免在边界上反复向伙伴系统要页、还页)
+#define SLAB_KEEP_EMPTY 1
+
+#define MAX_CACHES 16
+static KmemCache caches[MAX_CACHES];
+static int nr_caches = 0;
+static spinlock_t caches_lock;
+
+#define FREE_LINK(c, obj) (*(void **)((char *)(obj) + (c)->size - 8))
+
+// --- 双向链表 ---
+
+static void slab_unlink(Slab **head, Slab *s) {
+    if (s->prev) s->prev->next = s->next;
+    else *head = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->next = s->prev = 0;
+}
+
+static void slab_push(Slab **head, Slab *s) {
+    s->prev = 0;
+    s->next = *head;
+    if (*head) (*head)->prev = s;
+    *head = s;
+}
+
+static char* slab_obj(Slab *s, int i) {
+    return (char *)s + SLAB_HEADER + (uint64_t)i * s->cache->size;
+}
+
+// 创建一个 cache；size 向上对齐到 8 字节，不小于一个 cache line 的对象对齐到 cache line
+KmemCache* kmem_cache_create(char *name, uint64_t size, int (*ctor)(void *), void (*dtor)(void *)) {
+    size = (size + 7) & ~7UL;
+    if (size < 16) size = 16;
+    if (size >= CACHE_LINE) size = (size + CACHE_LINE - 1) & ~(uint64_t)(CACHE_LINE - 1);
+    if (size > PAGE_SIZE - SLAB_HEADER) {
+        printf("[Kernel] kmem_cache_create: %s: object too large (%lu)\n", name, size);
+        return 0;
+    }
+
+    spin_lock(&caches_lock);
+    if (nr_caches == MAX_CACHES) {
+        spin_unlock(&caches_lock);
+        printf("[Kernel] kmem_cache_create: too many caches\n");
+        return 0;
+    }
+    KmemCache *c = &caches[nr_caches++];
+    spin_unlock(&caches_lock);
+
+    c->name = name;
+    c->size = size;
+    c->per_slab = (PAGE_SIZE - SLAB_HEADER) / size;
+    c->ctor = ctor;
+    c->dtor = dtor;
+    return c;
+}
+
+// 析构所有对象，把页还给伙伴系统 (slab 已经从链表上摘下，所有对象都是空闲的)
+static void slab_destroy(KmemCache *c, Slab *s) {
+    if (c->dtor) {
+        for (int i = 0; i < c->per_slab; i++) c->dtor(slab_obj(s, i));
+    }
+    free_pages(s, 0);
+}
+
+// 新建一个 slab：不持有 cache 的锁 (要页时伙伴系统可能回过头来让 slab 回收空页)
+static Slab* slab_create(KmemCache *c) {
+    Slab *s = (Slab *)alloc_pages(0);
+    if (s == 0) return 0;
+
+    s->cache = c;
+    s->next = s->prev = 0;
+    s->inuse = 0;
+    s->free = 0;
+    for (int i = c->per_slab - 1; i >= 0; i--) {
+        char *obj = slab_obj(s, i);
+        if (c->ctor && c->ctor(obj) != 0) {
+            // 构造失败：已经构造好的对象析构掉，整页还回去
+            if (c->dtor) {
+                for (int j = c->per_slab - 1; j > i; j--) c->dtor(slab_obj(s, j));
+            }
+            free_pages(s, 0);
+            return 0;
+        }
+        FREE_LINK(c, obj) = s->free;
+        s->free = obj;
+    }
+    return s;
+}
+
+void* kmem_cache_alloc(KmemCache *c) {
+    spin_lock(&c->lock);
+    if (c->partial == 0) {
+        spin_unlock(&c->lock);
+        Slab *s = slab_create(c);
+        if (s == 0) return 0;
+        spin_lock(&c->lock);
+        slab_push(&c->partial, s);
+        c->nr_slabs++;
+        c->nr_empty++;
+    }
+
+    Slab *s = c->partial;
+    void *obj = s->free;
+    s->free = FREE_LINK(c, obj);
+    if (s->inuse++ == 0) c->nr_empty--;
+    if (s->free == 0) {
+        slab_unlink(&c->partial, s);
+        slab_push(&c->full, s);
+    }
+    c->nr_inuse++;
+    c->nr_allocs++;
+    spin_unlock(&c->lock);
+    return obj;
+}
+
+void kmem_cache_free(KmemCache *c, void *obj) {
+    Slab *s = (Slab *)((uint64_t)obj & ~(uint64_t)(PAGE_SIZE - 1));
+    if (s->cache != c) {
+        printf("[Kernel] kmem_cache_free: %p does not belong to %s\n", obj, c->name);
+        return;
+    }
+
+    Slab *release = 0;
+    spin_lock(&c->lock);
+    if (s->free == 0) {
+        slab_unlink(&c->full, s);
+        slab_push(&c->partial, s);
+    }
+    FREE_LINK(c, obj) = s->free;
+    s->free = obj;
+    c->nr_inuse--;
+    c->nr_frees++;
+    if (--s->inuse == 0) {
+        if (c->nr_empty >= SLAB_KEEP_EMPTY) {
+            slab_unlink(&c->partial, s);
+            c->nr_slabs--;
+            release = s;
+        } else {
+            c->nr_empty++;
+        }
+    }
+    spin_unlock(&c->lock);
+
+    if (release) slab_destroy(c, release);
+}
+
+// 内存紧张时 (伙伴系统分配失败) 调用：所有 cache 的全空 slab 都还给伙伴系统
+// 返回还回去的页数
+int kmem_reap() {
+    int freed = 0;
+    for (int i = 0; i < nr_caches; i++) {
+        KmemCache *c = &caches[i];
+        Slab *empty = 0;
+
+        spin_lock(&c->lock);
+        Slab *s = c->partial;
+        while (s) {
+            Slab *nx = s->next;
+            if (s->inuse == 0) {
+                slab_unlink(&c->partial, s);
+                s->next = empty;
+                empty = s;
+                c->nr_slabs--;
+                c->nr_empty--;
+            }
+            s = nx;
+        }
+        spin_unlock(&c->lock);
+
+        while (empty) {
+            Slab *nx = empty->next;
+            slab_destroy(c, empty);
+            empty = nx;
+            freed++;
+        }
+    }
+    return freed;
+}
+
+// --- kmalloc：按 2 的幂分档的通用 cache ---
+// 大于 KMALLOC_MAX 的请直接用 alloc_pages
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_MAX_SHIFT 11
+#define KMALLOC_MAX (1 << KMALLOC_MAX_SHIFT)
+
+static KmemCache *kmalloc_caches[KMALLOC_MAX_SHIFT + 1];
+static char *kmalloc_names[KMALLOC_MAX_SHIFT + 1] = {
+    [4] = "kmalloc-16", [5] = "kmalloc-32", [6] = "kmalloc-64", [7] = "kmalloc-128",
+    [8] = "kmalloc-256", [9] = "kmalloc-512", [10] = "kmalloc-1024", [11] = "kmalloc-2048",
+};
+
+// mm_init 之后调用一次
+void kmem_init() {
+    for (int s = KMALLOC_MIN_SHIFT; s <= KMALLOC_MAX_SHIFT; s++) {
+        kmalloc_caches[s] = kmem_cache_create(kmalloc_names[s], 1UL << s, 0, 0);
+    }
+    printf("[Kernel] Slab allocator ready: kmalloc %d..%d bytes\n", 1 << KMALLOC_MIN_SHIFT, KMALLOC_MAX);
+}
+
+void* kmalloc(uint64_t size) {
+    if (size > KMALLOC_MAX) {
+        printf("[Kernel] kmalloc: %lu bytes is too large\n", size);
+        return 0;
+    }
+    int s = KMALLOC_MIN_SHIFT;
+    while ((1UL << s) < size) s++;
+    return kmem_cache_alloc(kmalloc_caches[s]);
+}
+
+void kfree(void *p) {
+    if (p == 0) return;
+    Slab *s = (Slab *)((uint64_t)p & ~(uint64_t)(PAGE_SIZE - 1));
+    kmem_cache_free(s->cache, p);
+}
+
+// 每个 cache 一行：对象大小、在用对象数、slab 数 (其中全空的)、累计分配/释放次数
+void kmem_stats() {
+    for (int i = 0; i < nr_caches; i++) {
+        KmemCache *c = &caches[i];
+        if (c->nr_allocs == 0) continue;
+        printf("[Kernel] slab %s: size=%lu inuse=%lu slabs=%d (empty %d) allocs=%lu frees=%lu\n",
+               c->name, c->size, c->nr_inuse, c->nr_slabs, c->nr_empty, c->nr_allocs, c->nr_frees);
+    }
+}
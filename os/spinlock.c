@@ -0,0 +1,22 @@
+// os/spinlock.c
+// 自旋锁：多个 hart 同时访问共享数据时使用
+// 内核态不开中断 (只有 idle 等待时短暂打开)，所以不需要关中断版本
+#include <stdint.h>
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+
+void spin_lock(spinlock_t *lk) {
+    // amoswap.w.aq：原子地写 1 并取回旧值，旧值为 0 说明抢到了
+    while (__sync_lock_test_and_set(&lk->locked, 1) != 0) {
+        // 先只读等待，减少总线上的原子操作
+        while (lk->locked) ;
+    }
+    __sync_synchronize();
+}
+
+void spin_unlock(spinlock_t *lk) {
+    __sync_synchronize();
+    __sync_lock_release(&lk->locked);
+}
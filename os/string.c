@@ -0,0 +1,175 @@
+// os/string.c
+// 内核的内存拷贝/填充库
+//   memcpy / memset：任意长度，首尾按字节，中间按 8 字节对齐、一次 8 个字展开
+//   copy_page / clear_page：整页 (4KB，页对齐) 的专用入口，COW 复制、清零页池、ELF 加载都走这里
+// 开机时 string_init 探测 V 扩展：有的话整页操作和大块 memcpy/memset 换成向量版本 (string_rvv.S)
+//
+// 注意：这个文件用 -fno-tree-loop-distribute-patterns 编译 (见 Makefile)，
+// 否则 GCC 会把下面的循环识别成 memcpy/memset 调用，变成自己调自己
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void* alloc_pages(int order);
+void free_pages(void *pa, int order);
+
+#define PAGE_SIZE 4096
+
+// string_rvv.S
+void rvv_memcpy(void *dst, const void *src, uint64_t n);
+void rvv_memset(void *dst, int c, uint64_t n);
+
+// 小于这个长度时向量版本的 vsetvli 开销不划算
+#define RVV_THRESHOLD 256
+
+#define SSTATUS_VS (3L << 9)
+#define SSTATUS_VS_INITIAL (1L << 9)
+
+int has_rvv = 0;
+
+// --- 按字节 (只用于首尾和没法对齐的情况，也是跑分的基准) ---
+
+static void byte_copy(char *d, const char *s, uint64_t n) {
+    while (n--) *d++ = *s++;
+}
+
+static void byte_set(char *d, int c, uint64_t n) {
+    while (n--) *d++ = (char)c;
+}
+
+// --- 按 8 字节字，一次 8 个字 (64 字节，一个 cache line) ---
+// 调用者保证 d、s 都 8 字节对齐
+
+static void word_copy(uint64_t *d, const uint64_t *s, uint64_t words) {
+    while (words >= 8) {
+        uint64_t a0 = s[0], a1 = s[1], a2 = s[2], a3 = s[3];
+        uint64_t a4 = s[4], a5 = s[5], a6 = s[6], a7 = s[7];
+        d[0] = a0; d[1] = a1; d[2] = a2; d[3] = a3;
+        d[4] = a4; d[5] = a5; d[6] = a6; d[7] = a7;
+        d += 8;
+        s += 8;
+        words -= 8;
+    }
+    while (words--) *d++ = *s++;
+}
+
+static void word_set(uint64_t *d, uint64_t v, uint64_t words) {
+    while (words >= 8) {
+        d[0] = v; d[1] = v; d[2] = v; d[3] = v;
+        d[4] = v; d[5] = v; d[6] = v; d[7] = v;
+        d += 8;
+        words -= 8;
+    }
+    while (words--) *d++ = v;
+}
+
+static void memcpy_word(void *dst, const void *src, uint64_t n) {
+    char *d = dst;
+    const char *s = src;
+    // 源和目的对 8 取模不同，怎么对齐都有一边不对齐，只能按字节
+    if (((uint64_t)d ^ (uint64_t)s) & 7) {
+        byte_copy(d, s, n);
+        return;
+    }
+    uint64_t head = (8 - ((uint64_t)d & 7)) & 7;
+    if (head > n) head = n;
+    byte_copy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    word_copy((uint64_t *)d, (const uint64_t *)s, n / 8);
+    byte_copy(d + (n & ~7UL), s + (n & ~7UL), n & 7);
+}
+
+static void memset_word(void *dst, int c, uint64_t n) {
+    char *d = dst;
+    uint64_t head = (8 - ((uint64_t)d & 7)) & 7;
+    if (head > n) head = n;
+    byte_set(d, c, head);
+    d += head;
+    n -= head;
+
+    uint64_t v = (uint8_t)c;
+    v |= v << 8;
+    v |= v << 16;
+    v |= v << 32;
+    word_set((uint64_t *)d, v, n / 8);
+    byte_set(d + (n & ~7UL), c, n & 7);
+}
+
+void* memcpy(void *dst, const void *src, uint64_t n) {
+    if (has_rvv && n >= RVV_THRESHOLD) rvv_memcpy(dst, src, n);
+    else memcpy_word(dst, src, n);
+    return dst;
+}
+
+void* memset(void *dst, int c, uint64_t n) {
+    if (has_rvv && n >= RVV_THRESHOLD) rvv_memset(dst, c, n);
+    else memset_word(dst, c, n);
+    return dst;
+}
+
+// 整页：页对齐，跳过对齐判断和首尾处理
+void copy_page(void *dst, const void *src) {
+    if (has_rvv) rvv_memcpy(dst, src, PAGE_SIZE);
+    else word_copy(dst, src, PAGE_SIZE / 8);
+}
+
+void clear_page(void *dst) {
+    if (has_rvv) rvv_memset(dst, 0, PAGE_SIZE);
+    else word_set(dst, 0, PAGE_SIZE / 8);
+}
+
+// 开机时调用一次：S 态读不到 misa，就试着打开 sstatus.VS
+// 没有 V 扩展时 VS 字段恒为 0 (WARL)，写进去读回来还是 0
+void string_init() {
+    uint64_t sstatus;
+    asm volatile("csrs sstatus, %0" : : "r"(SSTATUS_VS_INITIAL));
+    asm volatile("csrr %0, sstatus" : "=r"(sstatus));
+    asm volatile("csrc sstatus, %0" : : "r"(SSTATUS_VS));
+    has_rvv = (sstatus & SSTATUS_VS) != 0;
+    printf("[Kernel] string: %s memcpy/memset\n", has_rvv ? "RVV" : "64-bit word");
+}
+
+// --- 跑分：每个版本复制/清零一页的平均周期数 (sys_membench 调用) ---
+// op: 0 复制, 1 清零；variant: 0 按字节, 1 按字, 2 向量
+// 没有 V 扩展时 variant 2 返回 -1
+#define BENCH_ROUNDS 64
+
+static uint64_t rdcycle() {
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+int64_t string_bench(int op, int variant) {
+    if (op < 0 || op > 1 || variant < 0 || variant > 2) return -1;
+    if (variant == 2 && !has_rvv) return -1;
+
+    char *src = (char *)alloc_pages(0);
+    char *dst = (char *)alloc_pages(0);
+    if (src == 0 || dst == 0) {
+        if (src) free_pages(src, 0);
+        if (dst) free_pages(dst, 0);
+        return -1;
+    }
+    for (int i = 0; i < PAGE_SIZE; i++) src[i] = (char)i;
+
+    uint64_t c0 = rdcycle();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        if (op == 0) {
+            if (variant == 0) byte_copy(dst, src, PAGE_SIZE);
+            else if (variant == 1) word_copy((uint64_t *)dst, (uint64_t *)src, PAGE_SIZE / 8);
+            else rvv_memcpy(dst, src, PAGE_SIZE);
+        } else {
+            if (variant == 0) byte_set(dst, 0, PAGE_SIZE);
+            else if (variant == 1) word_set((uint64_t *)dst, 0, PAGE_SIZE / 8);
+            else rvv_memset(dst, 0, PAGE_SIZE);
+        }
+    }
+    uint64_t cycles = rdcycle() - c0;
+
+    free_pages(src, 0);
+    free_pages(dst, 0);
+    return cycles / BENCH_ROUNDS;
+}
@@ -3,230 +3,1148 @@
 
 void printf(char *fmt, ...);
 void* frame_alloc(); // mm.c
+void frame_dealloc(void *pa);
+void* alloc_pages(int order);
+void free_pages(void *pa, int order);
+int mm_refill_zero_pool(int max);
+void mm_stats();
 typedef uint64_t* pagetable_t; // paging.c
 pagetable_t uvm_create();
-void uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+extern pagetable_t kernel_pagetable;
 extern void __switch(uint64_t *current_cx_ptr, uint64_t *next_cx_ptr);
+extern void __task_entry();
+void timer_record_dispatch();
+void timer_stats();
+void console_stats();
+void uring_stats();
+void klog_stats();
+void loader_stats();
+void klog_drain();
+void klog(int level, char *fmt, ...);
+#define LOG_ERR 3
+#define LOG_INFO 6
+int vdso_map(pagetable_t pt, int pid);
+long sbi_send_ipi(uint64_t hart_mask);
+uint64_t r_time();
+void timer_idle_enter();
+void timer_idle_exit();
+
+// 定时器 (和 timer.c 里的定义保持一致)
+typedef struct Timer {
+    uint64_t expires;
+    void (*fn)(void *arg);
+    void *arg;
+    struct Timer *next;
+} Timer;
+void timer_add(Timer *t, uint64_t deadline, void (*fn)(void *), void *arg);
+int vdso_fork(pagetable_t child_pt, int pid);
+void trace_event(int type, uint64_t a, uint64_t b);
+#define TR_SWITCH 4
+#define TR_FORK 7
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
 
 // --- 宏定义 ---
 #define PAGE_SIZE 4096
-#define MAX_APP_NUM 4
 
-// 虚拟地址布局：
-// 0x10000 -> App 代码
-// 0x20000 -> App 栈 (栈底)
-#define USER_CODE_START 0x10000
-#define USER_STACK_START 0x20000 
+// 最多支持的 hart 数量 (QEMU -smp N 里实际存在的 hart 在启动时探测)
+#ifndef NCPU
+#define NCPU 8
+#endif
+
+// 用户虚拟地址布局：
+//   程序各段      ELF 决定 (user/linker.ld 从 0x10000 开始)
+//   堆            紧跟在最高的段后面，sys_brk 向上扩展
+//   ...           (空洞，不占任何内存)
+//   栈            用户空间的最高处，缺页时向下扩展，最多 USER_STACK_MAX
+#define USER_TOP 0x80000000L
+#define USER_STACK_TOP USER_TOP
+#define USER_STACK_MAX (256 * PAGE_SIZE)
+#define USER_STACK_LIMIT (USER_STACK_TOP - USER_STACK_MAX)
+// 固定映射的几页，堆不能长到这里：
+//   提交/完成队列页 (uring.c)，紧挨着它下面是 vDSO 的进程页和共享数据页 (vdso.c)
+#define URING_VA 0x70000000L
+#define VDSO_PROC_VA (URING_VA - PAGE_SIZE)
+#define VDSO_DATA_VA (URING_VA - 2 * PAGE_SIZE)
 
 // PTE 标志位
+#define PTE_V (1L << 0)
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4)
 
+// 任务状态
+#define TASK_READY    1 // 在某个 hart 的就绪队列里
+#define TASK_RUNNING  2 // 正在 CPU 上运行
+#define TASK_SLEEPING 3 // 等待某个事件 (chan)
+#define TASK_ZOMBIE   4 // 已退出，等待回收 TCB
+
+// --- 多级反馈队列 (MLFQ) ---
+// 级别 0 优先级最高、时间片最短；用满时间片的任务降级，
+// 主动让出/等待 I/O 的任务留在高优先级，定期把所有任务提回 0 级防止饿死
+#define MLFQ_LEVELS 3
+#define MLFQ_BOOST_TICKS 50
+static const int mlfq_slice[MLFQ_LEVELS] = {1, 2, 4};  // 每级的时间片 (时钟 tick 数)
+
+// TCB 和 VMA 从各自的 slab cache 分配 (slab.c)，内核栈单独一页
+typedef struct KmemCache KmemCache;
+KmemCache* kmem_cache_create(char *name, uint64_t size, int (*ctor)(void *), void (*dtor)(void *));
+void* kmem_cache_alloc(KmemCache *c);
+void kmem_cache_free(KmemCache *c, void *obj);
+void kmem_stats();
+KmemCache *task_cache;
+KmemCache *vma_cache;
+
+// PID 哈希表的桶数
+#define PID_HASH_SIZE 64
+
 typedef struct {
     uint64_t ra;
     uint64_t sp;
     uint64_t s[12];
 } TaskContext;
 
+// 虚拟内存区域 (VMA)：进程合法的一段用户地址 [start, end) 和它的权限
+// 区域里还没映射的页在第一次访问时由 task_page_fault 分配清零页
+// 每个进程的 VMA 按地址无关的顺序串成链表，节点从 vma_cache 分配
+// (和 loader.c 里的定义保持一致)
+typedef struct Vma {
+    uint64_t start;
+    uint64_t end;
+    int perm;
+    int flags;
+    struct Vma *next;
+} Vma;
+
+#define VMA_HEAP  (1 << 0)  // sys_brk 调整 end
+#define VMA_STACK (1 << 1)  // 缺页时向下扩展 start
+
+// elf_load 一次最多接受的段数
+#define MAX_SEGS 8
+
 // 调整结构体顺序防止踩踏
-typedef struct {
-    int is_running;
+typedef struct TaskControlBlock {
+    int state;
+    int pid;
     TaskContext context;
-    uint64_t kernel_stack[PAGE_SIZE / 8];
+    uint64_t *kstack;       // 内核栈 (一页)，由 task_cache 的构造函数分配，TCB 回到 cache 时也留着
     pagetable_t pagetable;
     uint64_t trap_cx_ppn;
+    uint64_t asid;          // 地址空间标识，写进 satp，TLB 表项按它区分
+    uint64_t asid_gen;      // asid 所属的代，和 asid_generation 不同说明已失效
+    uint64_t tlb_stale;     // 位图：这些 hart 上可能缓存着本地址空间过期的 TLB 表项
+    int level;              // 当前所在的 MLFQ 级别
+    int slice_left;         // 本级别剩余的时间片 (tick)
+    volatile int on_cpu;    // 1 表示还有 hart 在用它的内核栈 (切换尚未完成)
+    int cpu;                // 最近一次运行在哪个 hart 上
+    struct TaskControlBlock *parent;
+    int exit_code;
+    void *chan;             // TASK_SLEEPING 时等待的事件
+    Timer sleep_timer;      // sys_nanosleep 用的定时器，睡眠时 chan 指向它
+    Vma *vmas;              // VMA 链表
+    uint64_t brk;           // 当前的堆顶 (不一定按页对齐)
+    uint64_t faults_zero;   // 按需分配清零页的缺页次数 (.bss / 堆 / 栈)
+    uint64_t faults_cow;    // 写时复制缺页次数
+    uint64_t faults_stack;  // 其中让栈向下扩展的次数
+    void *uring;            // 提交/完成队列页的内核地址，0 表示没有建立 (uring.c)
+    int uring_flags;
+#ifdef FAULT_INJECT
+    int fail_next_fork;     // 1 表示下一次 fork 在复制完地址空间后故意失败 (sys_forkfail，测失败路径的泄漏)
+#endif
+    struct TaskControlBlock *next;      // 就绪队列 / 僵尸链表
+    struct TaskControlBlock *pid_next;  // PID 哈希链
 } TaskControlBlock;
 
-TaskControlBlock tasks[MAX_APP_NUM];
-int app_num = 0;
-TaskContext idle_cx;
-int current_task_id = -1;
+typedef struct {
+    uint64_t x[32];
+    uint64_t sstatus;
+    uint64_t sepc;
+    uint64_t kernel_tp;     // 回到用户态前保存的内核 tp (hartid)
+    uint64_t reserved;
+} TrapContext;
+
+// 每个 hart 一份的调度器状态
+typedef struct {
+    int hartid;
+    int online;
+    TaskControlBlock *current;  // 当前任务，0 表示在 idle
+    TaskControlBlock *prev;     // 刚切走、on_cpu 还没清掉的任务
+    TaskContext idle_cx;
+    uint64_t asid_gen_seen;     // 本 hart 的 TLB 已经刷新到的 ASID 代
+    int need_dispatch_record;
+    uint64_t mlfq_ticks;
+
+    // 就绪队列：每一级一个 FIFO，ready_bitmap 的第 i 位表示第 i 级非空
+    spinlock_t rq_lock;
+    TaskControlBlock *ready_head[MLFQ_LEVELS];
+    TaskControlBlock *ready_tail[MLFQ_LEVELS];
+    uint32_t ready_bitmap;
+    volatile int nr_ready;
+    uint64_t nr_stolen;         // 从别的 hart 偷来的任务数
+} Cpu;
 
-extern uint64_t _app_start;
-extern uint64_t _app_end;
+Cpu cpus[NCPU];
+
+// proc_lock 保护 PID 表、父子关系、睡眠/唤醒和僵尸链表
+spinlock_t proc_lock;
+TaskControlBlock *pid_table[PID_HASH_SIZE];
+TaskControlBlock *zombie_list = 0;
+int nr_tasks = 0;           // 还活着的任务数 (不含僵尸)
+
+int app_count();
+char* app_get(int i, char **elf, uint64_t *size);
+int app_find(char *name, char **elf, uint64_t *size);
+int elf_load(pagetable_t pagetable, char *elf, uint64_t size, uint64_t *entry,
+             Vma *vmas, int max_vmas, int *nr_vmas);
+void uvm_free(pagetable_t pagetable);
+void uvm_unmap(pagetable_t pagetable, uint64_t va, uint64_t npages);
+int uvm_cow_fault(pagetable_t pagetable, uint64_t va);
+uint64_t* walk(pagetable_t pagetable, uint64_t va, int alloc);
 extern void __restore_to_user();
-extern pagetable_t kernel_pagetable;
 
-void my_memcpy(void *dst, void *src, uint64_t len) {
-    char *d = dst; char *s = src;
-    while(len--) *d++ = *s++;
+// tp 寄存器里放的是 hartid (entry.S 设置，Trap 时由 trap_entry.S 恢复)
+int cpuid() {
+    uint64_t id;
+    asm volatile("mv %0, tp" : "=r"(id));
+    return id;
+}
+
+static Cpu* mycpu() {
+    return &cpus[cpuid()];
+}
+
+// --- 就绪队列操作 (都是 O(1)，调用者持有 c->rq_lock) ---
+
+static void ready_push(Cpu *c, TaskControlBlock *t) {
+    int l = t->level;
+    t->state = TASK_READY;
+    t->next = 0;
+    if (c->ready_tail[l]) c->ready_tail[l]->next = t;
+    else c->ready_head[l] = t;
+    c->ready_tail[l] = t;
+    c->ready_bitmap |= 1U << l;
+    c->nr_ready++;
+}
+
+static TaskControlBlock* ready_pop(Cpu *c) {
+    if (c->ready_bitmap == 0) return 0;
+    int l = __builtin_ctz(c->ready_bitmap);
+    TaskControlBlock *t = c->ready_head[l];
+    c->ready_head[l] = t->next;
+    if (c->ready_head[l] == 0) {
+        c->ready_tail[l] = 0;
+        c->ready_bitmap &= ~(1U << l);
+    }
+    c->nr_ready--;
+    t->next = 0;
+    return t;
+}
+
+// 放进某个 hart 的就绪队列
+// 无节拍 idle 下空闲的 hart 可能一直停在 wfi 里，给它发一个核间中断叫醒
+// 放进别的 hart 的队列就叫醒那个 hart；放进自己的队列就叫醒一个空闲的 hart 来偷
+static void kick_idle_hart(int hart) {
+    int self = cpuid();
+    if (hart == self) {
+        hart = -1;
+        for (int i = 0; i < NCPU; i++) {
+            if (i != self && cpus[i].online && cpus[i].current == 0) {
+                hart = i;
+                break;
+            }
+        }
+        if (hart < 0) return;
+    } else if (cpus[hart].current != 0) {
+        return;
+    }
+    sbi_send_ipi(1UL << hart);
+}
+
+static void make_ready(int hart, TaskControlBlock *t) {
+    Cpu *c = &cpus[hart];
+    spin_lock(&c->rq_lock);
+    ready_push(c, t);
+    spin_unlock(&c->rq_lock);
+    kick_idle_hart(hart);
+}
+
+// 工作窃取：自己没活干时，从其他 hart 的就绪队列里拿一个
+static TaskControlBlock* steal_task(Cpu *self) {
+    for (int i = 1; i < NCPU; i++) {
+        Cpu *c = &cpus[(self->hartid + i) % NCPU];
+        if (!c->online || c->nr_ready == 0) continue;
+
+        spin_lock(&c->rq_lock);
+        TaskControlBlock *t = ready_pop(c);
+        spin_unlock(&c->rq_lock);
+        if (t) {
+            self->nr_stolen++;
+            return t;
+        }
+    }
+    return 0;
+}
+
+static int any_ready() {
+    for (int i = 0; i < NCPU; i++) {
+        if (cpus[i].online && cpus[i].nr_ready > 0) return 1;
+    }
+    return 0;
+}
+
+// --- PID 表 (调用者持有 proc_lock) ---
+
+int pid_counter = 1;        // pid 分配器  递增形式
+int alloc_pid() { return pid_counter++; }
+
+static void pid_insert(TaskControlBlock *t) {
+    int h = t->pid % PID_HASH_SIZE;
+    t->pid_next = pid_table[h];
+    pid_table[h] = t;
+}
+
+static void pid_remove(TaskControlBlock *t) {
+    TaskControlBlock **pp = &pid_table[t->pid % PID_HASH_SIZE];
+    while (*pp) {
+        if (*pp == t) {
+            *pp = t->pid_next;
+            return;
+        }
+        pp = &(*pp)->pid_next;
+    }
+}
+
+TaskControlBlock* task_by_pid(int pid) {
+    TaskControlBlock *t = pid_table[pid % PID_HASH_SIZE];
+    while (t && t->pid != pid) t = t->pid_next;
+    return t;
+}
+
+int task_current_pid() {
+    TaskControlBlock *t = mycpu()->current;
+    return t ? t->pid : 0;
+}
+
+// --- TCB 分配与回收 ---
+
+// task_cache 的构造/析构：内核栈跟着 TCB 对象走，TCB 在 cache 里复用时不用重新分配
+static int tcb_ctor(void *obj) {
+    TaskControlBlock *t = (TaskControlBlock *)obj;
+    t->kstack = (uint64_t *)alloc_pages(0);
+    return t->kstack ? 0 : -1;
+}
+
+static void tcb_dtor(void *obj) {
+    free_pages(((TaskControlBlock *)obj)->kstack, 0);
+}
+
+static void vma_free_all(Vma *v) {
+    while (v) {
+        Vma *nx = v->next;
+        kmem_cache_free(vma_cache, v);
+        v = nx;
+    }
+}
+
+// 在 VMA 链表头上加一个区域，没有内存时返回 -1
+static int vma_add(Vma **list, uint64_t start, uint64_t end, int perm, int flags) {
+    Vma *v = (Vma *)kmem_cache_alloc(vma_cache);
+    if (v == 0) return -1;
+    v->start = start;
+    v->end = end;
+    v->perm = perm;
+    v->flags = flags;
+    v->next = *list;
+    *list = v;
+    return 0;
 }
 
+static TaskControlBlock* tcb_alloc() {
+    TaskControlBlock *t = (TaskControlBlock *)kmem_cache_alloc(task_cache);
+    if (t == 0) return 0;
+
+    // 除了构造好的内核栈，其余字段清零
+    uint64_t *kstack = t->kstack;
+    uint64_t *p = (uint64_t *)t;
+    for (uint64_t i = 0; i < sizeof(TaskControlBlock) / 8; i++) p[i] = 0;
+    t->kstack = kstack;
+
+    t->level = 0;
+    t->slice_left = mlfq_slice[0];
+    t->cpu = cpuid();
+
+    spin_lock(&proc_lock);
+    t->pid = alloc_pid();
+    pid_insert(t);
+    nr_tasks++;
+    spin_unlock(&proc_lock);
+    return t;
+}
+
+static void tcb_free(TaskControlBlock *t) {
+    vma_free_all(t->vmas);
+    kmem_cache_free(task_cache, t);
+}
+
+// 释放已经切走的僵尸任务的 TCB (已经没有 hart 在用它的内核栈)
+static void reap_zombies() {
+    if (zombie_list == 0) return;
+
+    spin_lock(&proc_lock);
+    TaskControlBlock **pp = &zombie_list;
+    while (*pp) {
+        TaskControlBlock *t = *pp;
+        if (t->on_cpu) {
+            pp = &t->next;
+            continue;
+        }
+        *pp = t->next;
+        tcb_free(t);
+    }
+    spin_unlock(&proc_lock);
+}
+
+static TrapContext* task_trap_cx(TaskControlBlock *t) {
+    return (TrapContext *)((uint64_t)t->kstack + PAGE_SIZE - sizeof(TrapContext));
+}
+
+// 为任务 t 建立一个新的用户地址空间并加载 ELF
+// 成功时 *pt_out 是新页表，t 的 VMA 和堆已更新，返回入口地址；失败返回 0 (t 不受影响)
+static uint64_t load_image(TaskControlBlock *t, char *elf, uint64_t size, pagetable_t *pt_out) {
+    // 1. 创建用户页表 (链接共享的内核子树)
+    pagetable_t pt = uvm_create();
+    if (pt == 0) return 0;
+
+    // 2. 按 ELF 的段映射代码和数据，每个段一个 VMA (.bss 部分按需分配)
+    Vma segs[MAX_SEGS];
+    int n = 0;
+    uint64_t entry;
+    if (elf_load(pt, elf, size, &entry, segs, MAX_SEGS, &n) < 0 || vdso_map(pt, t->pid) < 0) {
+        uvm_free(pt);
+        return 0;
+    }
+
+    // 3. 堆：从最高的段之后开始，一开始是空的
+    uint64_t heap_start = 0;
+    for (int i = 0; i < n; i++) {
+        if (segs[i].end > heap_start) heap_start = segs[i].end;
+    }
+
+    // 4. 栈：先只保留最高的一页，用到更低的地址时再向下扩展
+    Vma *list = 0;
+    int ok = vma_add(&list, heap_start, heap_start, PTE_R | PTE_W | PTE_U, VMA_HEAP) == 0 &&
+             vma_add(&list, USER_STACK_TOP - PAGE_SIZE, USER_STACK_TOP, PTE_R | PTE_W | PTE_U, VMA_STACK) == 0;
+    for (int i = 0; ok && i < n; i++) {
+        ok = vma_add(&list, segs[i].start, segs[i].end, segs[i].perm, segs[i].flags) == 0;
+    }
+    if (!ok) {
+        vma_free_all(list);
+        uvm_free(pt);
+        return 0;
+    }
+
+    // exec 时换掉旧程序的 VMA
+    vma_free_all(t->vmas);
+    t->vmas = list;
+    t->brk = heap_start;
+    t->faults_zero = t->faults_cow = t->faults_stack = 0;
+    *pt_out = pt;
+    return entry;
+}
+
+// 设置第一次进入用户态的 Trap 上下文
+static void init_user_cx(TrapContext *cx, uint64_t entry) {
+    for (int i = 0; i < 32; i++) cx->x[i] = 0;
+    cx->sstatus = (1L << 18); // SUM=1
+    cx->sepc = entry;
+    // 栈向下生长，所以 SP 设为栈顶
+    cx->x[2] = USER_STACK_TOP;
+}
+
+// 创建第一个用户进程：应用表里的第 0 个程序
 void task_init() {
     printf("[Kernel] Initializing tasks with Virtual Memory...\n");
-    app_num = 1;        // 修改创建的任务数量
-
-    uint64_t app_size = (uint64_t)&_app_end - (uint64_t)&_app_start;
-
-    for (int i = 0; i < app_num; i++) {
-        // 1. 创建用户页表 (复制内核页表)
-        tasks[i].pagetable = (pagetable_t)frame_alloc();
-        my_memcpy(tasks[i].pagetable, kernel_pagetable, PAGE_SIZE);
-
-        // 2. 映射用户代码 (Text)
-        void *app_mem = frame_alloc();
-        my_memcpy(app_mem, &_app_start, app_size);
-        
-        // 刷新指令缓存 防止CPU读到旧数据
-        asm volatile("fence.i");
-
-        // 映射到 0x10000, 权限 R|W|X|U
-        uvm_map(tasks[i].pagetable, USER_CODE_START, (uint64_t)app_mem, PAGE_SIZE, 
-                PTE_R | PTE_W | PTE_X | PTE_U);
-
-        // 3. 映射用户栈 (Stack) - 🔴【修复点】
-        void *stack_mem = frame_alloc();
-        // 映射到 0x20000, 权限 R|W|U (用户可读写)
-        uvm_map(tasks[i].pagetable, USER_STACK_START, (uint64_t)stack_mem, PAGE_SIZE, 
-                PTE_R | PTE_W | PTE_U);
-
-        // 4. 初始化内核栈逻辑
-        uint64_t kstack_top = (uint64_t)&tasks[i].kernel_stack[PAGE_SIZE/8];
-        
-        tasks[i].context.ra = (uint64_t)__restore_to_user;
-        tasks[i].context.sp = kstack_top;
-
-        typedef struct {
-            uint64_t x[32];
-            uint64_t sstatus;
-            uint64_t sepc;
-        } TrapContext;
-        
-        kstack_top -= sizeof(TrapContext);
-        TrapContext *cx = (TrapContext *)kstack_top;
-        tasks[i].context.sp = kstack_top;
-
-        cx->sstatus = (1L << 18); // SUM=1
-        cx->sepc = USER_CODE_START; // 0x10000
-        
-        // 🔴【关键】设置用户栈指针
-        // 栈向下生长，所以 SP 设为 (Start + Size)
-        cx->x[2] = USER_STACK_START + PAGE_SIZE; 
-
-        tasks[i].is_running = 1;
-        printf("[Kernel] Task %d created. PT=%x\n", i, tasks[i].pagetable);
+
+    task_cache = kmem_cache_create("task", sizeof(TaskControlBlock), tcb_ctor, tcb_dtor);
+    vma_cache = kmem_cache_create("vma", sizeof(Vma), 0, 0);
+
+    char *elf;
+    uint64_t size;
+    char *name = app_get(0, &elf, &size);
+    if (name == 0) {
+        printf("[Kernel] task_init: no application embedded!\n");
+        while(1);
+    }
+
+    TaskControlBlock *t = tcb_alloc();
+    if (t == 0) {
+        printf("[Kernel] task_init: no memory for TCB!\n");
+        while(1);
+    }
+
+    uint64_t entry = load_image(t, elf, size, &t->pagetable);
+    if (entry == 0) {
+        printf("[Kernel] task_init: failed to load %s\n", name);
+        while(1);
+    }
+
+    // 初始化内核栈逻辑
+    // TrapContext 放在内核栈顶，第一次被调度时经 __task_entry 进入用户态
+    TrapContext *cx = task_trap_cx(t);
+    t->context.ra = (uint64_t)__task_entry;
+    t->context.sp = (uint64_t)cx;
+    init_user_cx(cx, entry);
+
+    make_ready(cpuid(), t);
+    printf("[Kernel] Task %d (%s) created. PT=%p, %d apps embedded\n",
+           t->pid, name, t->pagetable, app_count());
+}
+
+// --- ASID 分配 ---
+// 每一代里 ASID 从 1 开始递增分配，绝不重复；用完时进入下一代
+// 这样切换地址空间时不再需要 sfence.vma，各进程的 TLB 表项可以共存
+// 每个 hart 在第一次看到新的一代时全刷一次自己的 TLB
+extern int asid_bits; // paging.c
+spinlock_t asid_lock;
+volatile uint64_t asid_generation = 1;
+uint64_t next_asid = 1;
+
+static void assign_asid(TaskControlBlock *t) {
+    if (asid_bits == 0) {
+        t->asid = 0;
+        return;
     }
+    if (t->asid_gen == asid_generation) return;
+
+    spin_lock(&asid_lock);
+    if (next_asid >= (1UL << asid_bits)) {
+        // ASID 回绕：旧的一代全部作废
+        asid_generation++;
+        next_asid = 1;
+    }
+    t->asid = next_asid++;
+    t->asid_gen = asid_generation;
+    t->tlb_stale = 0;
+    spin_unlock(&asid_lock);
 }
 
+static void switch_satp(Cpu *c, TaskControlBlock *t) {
+    uint64_t satp;
+    if (t) {
+        // 带上 ASID，其他进程的 TLB 表项不受影响，不需要刷新
+        assign_asid(t);
+        satp = (8L << 60) | (t->asid << 44) | (((uint64_t)t->pagetable) >> 12);
+    } else {
+        // idle 使用内核页表 (ASID 0)
+        satp = (8L << 60) | (((uint64_t)kernel_pagetable) >> 12);
+    }
+    asm volatile("csrw satp, %0" : : "r"(satp));
+
+    if (asid_bits == 0 || c->asid_gen_seen != asid_generation) {
+        // 硬件不支持 ASID，或者 ASID 回绕过：本 hart 的 TLB 全刷
+        c->asid_gen_seen = asid_generation;
+        asm volatile("sfence.vma zero, zero");
+    } else if (t && (t->tlb_stale & (1UL << c->hartid))) {
+        // 这个地址空间在别的 hart 上改过映射，本 hart 的缓存可能过期
+        __sync_fetch_and_and(&t->tlb_stale, ~(1UL << c->hartid));
+        asm volatile("sfence.vma zero, %0" : : "r"(t->asid));
+    }
+}
+
+// 当前 hart 修改了当前地址空间的映射并刷新了自己的 TLB
+// 其他 hart 等它下次在那里运行时再刷新 (单线程进程同一时刻只在一个 hart 上)
+void task_tlb_changed() {
+    Cpu *c = mycpu();
+    if (c->current) {
+        c->current->tlb_stale = ~(1UL << c->hartid);
+    }
+}
+
+// __switch 返回之后 (已经在新任务的栈上) 调用：
+// 释放刚切走的任务，从此别的 hart 可以安全地运行它
+void finish_task_switch() {
+    Cpu *c = mycpu();
+    if (c->prev) {
+        __sync_synchronize();
+        c->prev->on_cpu = 0;
+        c->prev = 0;
+    }
+}
+
+// 从就绪队列中取出下一个任务并切换过去
+// 当前任务如果还在运行，放回它所在级别的队尾
+// 本 hart 队列为空时去别的 hart 偷；都没有就回到 idle (task_idle_loop)
 void schedule() {
-    int next_id;
-    
-    if (current_task_id == -1) {
-        next_id = 0;
+    Cpu *c = mycpu();
+    TaskControlBlock *prev = c->current;
+
+    reap_zombies();
+
+    spin_lock(&c->rq_lock);
+    if (prev && prev->state == TASK_RUNNING) {
+        ready_push(c, prev);
+    }
+    TaskControlBlock *next = ready_pop(c);
+    spin_unlock(&c->rq_lock);
+
+    if (next == 0) next = steal_task(c);
+
+    if (c->need_dispatch_record) {
+        // 这次调度是时钟中断抢占引起的，记录调度延迟
+        c->need_dispatch_record = 0;
+        timer_record_dispatch();
+    }
+
+    if (next == prev) {
+        // 只有它自己可运行，不用切换
+        if (prev) prev->state = TASK_RUNNING;
+        return;
+    }
+
+    c->prev = prev;
+
+    if (next == 0) {
+        // 没有可运行的任务了
+        c->current = 0;
+        switch_satp(c, 0);
+        trace_event(TR_SWITCH, prev->pid, 0);
+        __switch((uint64_t *)&prev->context, (uint64_t *)&c->idle_cx);
+        finish_task_switch();
+        return;
+    }
+
+    // 它可能刚在别的 hart 上被切走，等那边的 __switch 保存完上下文
+    while (next->on_cpu) ;
+    __sync_synchronize();
+
+    next->on_cpu = 1;
+    next->state = TASK_RUNNING;
+    next->cpu = c->hartid;
+    c->current = next;
+
+    switch_satp(c, next);
+    trace_event(TR_SWITCH, prev ? prev->pid : 0, next->pid);
+
+    if (prev) {
+        __switch((uint64_t *)&prev->context, (uint64_t *)&next->context);
     } else {
-        // 必须模 MAX_APP_NUM (4)，不能模 app_num (1)
-        // 否则调度器永远看不到 fork 出来的 Task 1, 2, 3
-        next_id = (current_task_id + 1) % MAX_APP_NUM;
-    }
-
-    // 循环查找下一个 is_running == 1 的任务
-    int loop_count = 0;
-    while (tasks[next_id].is_running == 0) {
-        // 这里也要模 MAX_APP_NUM
-        next_id = (next_id + 1) % MAX_APP_NUM;
-        
-        loop_count++;
-        // 如果找了一整圈都没人，说明所有任务都退出了
-        if (loop_count >= MAX_APP_NUM) {
+        __switch((uint64_t *)&c->idle_cx, (uint64_t *)&next->context);
+    }
+    // 回到这里时可能已经在另一个 hart 上了
+    finish_task_switch();
+}
+
+int all_done_reported = 0;
+
+// idle 路径：每个 hart 初始化完后进入这里，永不返回
+// 有就绪任务 (自己的或者可以偷的) 就切过去；
+// 没有就补充清零页池，池子满了就 wfi 等中断
+void task_idle_loop() {
+    Cpu *c = mycpu();
+    c->online = 1;
+
+    while (1) {
+        reap_zombies();
+
+        if (any_ready()) {
+            timer_idle_exit();
+            schedule();
+            continue;
+        }
+
+        if (nr_tasks == 0 && __sync_lock_test_and_set(&all_done_reported, 1) == 0) {
             printf("[Kernel] All tasks finished!\n");
-            while(1);
+            mm_stats();
+            kmem_stats();
+            timer_stats();
+            console_stats();
+            uring_stats();
+            loader_stats();
+            klog_stats();
+            for (int i = 0; i < NCPU; i++) {
+                if (cpus[i].online) printf("[Kernel] hart %d stole %lu tasks\n", i, cpus[i].nr_stolen);
+            }
         }
+
+        // 空转时把积压的内核日志写到控制台，顺便补充清零页池
+        klog_drain();
+        if (mm_refill_zero_pool(1) > 0) continue;
+
+        // 等中断：没有时间片，时钟中断只为最早的定时器设定 (无节拍)
+        // 别的 hart 给我们放了任务会发核间中断 (kick_idle_hart)
+        // wfi 时 SIE 还关着：sie 里打开的中断一旦挂起就会把 hart 叫醒，只是先不进 trap，
+        // 所以 any_ready() 之后才到的核间中断 / 串口中断不会在 wfi 之前被"用掉"，然后睡死
+        // 醒来后短暂打开 SIE，让挂起的中断进 trap_handler 处理
+        timer_idle_enter();
+        if (!any_ready()) asm volatile("wfi");
+        asm volatile("csrsi sstatus, 2");
+        asm volatile("csrci sstatus, 2");
     }
-    
-    int prev_id = current_task_id;
-    current_task_id = next_id;
-    
-    // 切换页表
-    uint64_t next_satp = (8L << 60) | (((uint64_t)tasks[next_id].pagetable) >> 12);
-    asm volatile("csrw satp, %0" : : "r"(next_satp));
-    asm volatile("sfence.vma");
-    
-    if (prev_id != -1) {
-        __switch((uint64_t *)&tasks[prev_id].context, (uint64_t *)&tasks[next_id].context);
+}
+
+void task_yield() { schedule(); }
+
+// 时间片用完，被时钟中断强制让出 CPU
+void task_preempt() { mycpu()->need_dispatch_record = 1; schedule(); }
+
+// 时钟中断打断用户态时调用：扣时间片，用完就降级并抢占
+void task_tick() {
+    Cpu *c = mycpu();
+    TaskControlBlock *cur = c->current;
+    c->mlfq_ticks++;
+
+    if (c->mlfq_ticks % MLFQ_BOOST_TICKS == 0) {
+        // 定期提升：本 hart 的所有就绪任务回到 0 级
+        spin_lock(&c->rq_lock);
+        for (int l = 1; l < MLFQ_LEVELS; l++) {
+            TaskControlBlock *t;
+            while (c->ready_head[l]) {
+                t = c->ready_head[l];
+                c->ready_head[l] = t->next;
+                c->nr_ready--;
+                t->level = 0;
+                t->slice_left = mlfq_slice[0];
+                ready_push(c, t);
+            }
+            c->ready_tail[l] = 0;
+            c->ready_bitmap &= ~(1U << l);
+        }
+        spin_unlock(&c->rq_lock);
+        if (cur) {
+            cur->level = 0;
+            cur->slice_left = mlfq_slice[0];
+        }
+    }
+
+    if (cur == 0) return;
+
+    if (--cur->slice_left > 0) return;
+
+    // 整个时间片都在算，说明是 CPU 密集型，降一级
+    if (cur->level < MLFQ_LEVELS - 1) cur->level++;
+    cur->slice_left = mlfq_slice[cur->level];
+    task_preempt();
+}
+
+// 等到了 I/O (比如 sys_read 拿到了字符)：提回最高优先级
+void task_io_boost() {
+    TaskControlBlock *cur = mycpu()->current;
+    if (cur == 0) return;
+    cur->level = 0;
+    cur->slice_left = mlfq_slice[0];
+}
+
+// --- 睡眠与唤醒 ---
+
+// 调用者持有 proc_lock；返回时重新持有
+// 先标记为 SLEEPING 再放锁，唤醒者拿到锁时一定能看到它在睡
+static void sleep_locked(void *chan) {
+    TaskControlBlock *t = mycpu()->current;
+    t->chan = chan;
+    t->state = TASK_SLEEPING;
+    spin_unlock(&proc_lock);
+
+    schedule();
+
+    spin_lock(&proc_lock);
+}
+
+// 调用者持有 proc_lock
+static void wakeup_locked(void *chan) {
+    for (int h = 0; h < PID_HASH_SIZE; h++) {
+        for (TaskControlBlock *t = pid_table[h]; t; t = t->pid_next) {
+            if (t->state == TASK_SLEEPING && t->chan == chan) {
+                t->chan = 0;
+                make_ready(t->cpu, t);
+            }
+        }
+    }
+}
+
+// 给驱动用的睡眠：调用者持有 lk，在 chan 上睡眠，醒来后重新持有 lk
+// 先拿到 proc_lock 再放 lk，唤醒者 (持有 lk 改完状态后调用 task_wakeup) 不会错过我们
+void task_sleep(void *chan, spinlock_t *lk) {
+    spin_lock(&proc_lock);
+    spin_unlock(lk);
+    sleep_locked(chan);
+    spin_unlock(&proc_lock);
+    spin_lock(lk);
+}
+
+// 唤醒所有睡在 chan 上的任务
+void task_wakeup(void *chan) {
+    spin_lock(&proc_lock);
+    wakeup_locked(chan);
+    spin_unlock(&proc_lock);
+}
+
+// 定时器到期 (时钟中断里)：唤醒睡在这个定时器上的任务
+static void sleep_timer_fire(void *arg) {
+    TaskControlBlock *t = (TaskControlBlock *)arg;
+    task_wakeup(&t->sleep_timer);
+}
+
+// 睡到 rdtime 达到 deadline 为止
+// 定时器挂在当前 hart 的时间轮上；持有 proc_lock 时中断是关着的，
+// 所以它最早也要等我们在 sleep_locked 里切走之后才会触发，唤醒不会丢
+void task_sleep_until(uint64_t deadline) {
+    TaskControlBlock *t = mycpu()->current;
+    if (deadline <= r_time()) {
+        task_yield();
+        return;
+    }
+    spin_lock(&proc_lock);
+    timer_add(&t->sleep_timer, deadline, sleep_timer_fire, t);
+    sleep_locked(&t->sleep_timer);
+    spin_unlock(&proc_lock);
+}
+
+void task_exit(int code) {
+    TaskControlBlock *t = mycpu()->current;
+
+    // 每次进程退出都有一行，fork 密集的负载下只写进日志环，空闲时再上控制台
+    klog(LOG_INFO, "[Kernel] App %d exited with code %d (faults: zero=%lu cow=%lu stack=%lu)",
+           t->pid, code, t->faults_zero, t->faults_cow, t->faults_stack);
+
+    // 拆掉地址空间：先换到内核页表，再释放用户页和页表页
+    // 这个 ASID 在本代里不会再分配给别人，各 hart 上残留的 TLB 表项不会再被用到
+    switch_satp(mycpu(), 0);
+    uvm_free(t->pagetable);
+    t->pagetable = 0;
+    t->uring = 0;
+    vma_free_all(t->vmas);
+    t->vmas = 0;
+
+    spin_lock(&proc_lock);
+
+    // 子进程变成孤儿：已经是僵尸的直接交给回收链表
+    for (int h = 0; h < PID_HASH_SIZE; h++) {
+        TaskControlBlock *child = pid_table[h];
+        while (child) {
+            TaskControlBlock *nx = child->pid_next;
+            if (child->parent == t) {
+                child->parent = 0;
+                if (child->state == TASK_ZOMBIE) {
+                    pid_remove(child);
+                    child->next = zombie_list;
+                    zombie_list = child;
+                }
+            }
+            child = nx;
+        }
+    }
+
+    t->exit_code = code;
+    t->state = TASK_ZOMBIE;
+    nr_tasks--;
+
+    if (t->parent) {
+        // 留在 PID 表里等父进程 wait
+        wakeup_locked(t->parent);
     } else {
-        printf("[Kernel] Idle -> Task %d\n", next_id);
-        __switch((uint64_t *)&idle_cx, (uint64_t *)&tasks[next_id].context);
+        // 没人等它：切走以后直接回收
+        pid_remove(t);
+        t->next = zombie_list;
+        zombie_list = t;
     }
+    spin_unlock(&proc_lock);
+
+    schedule();
 }
 
+// 等待子进程退出，pid 为 -1 表示任意子进程
+// 返回子进程 PID，没有这样的子进程返回 -1
+int task_waitpid(int pid, int *exit_code) {
+    TaskControlBlock *self = mycpu()->current;
 
-void task_yield() { schedule(); }
-void task_exit() { tasks[current_task_id].is_running = 0; schedule(); }
+    spin_lock(&proc_lock);
+    while (1) {
+        int has_child = 0;
+        for (int h = 0; h < PID_HASH_SIZE; h++) {
+            for (TaskControlBlock *t = pid_table[h]; t; t = t->pid_next) {
+                if (t->parent != self || (pid != -1 && t->pid != pid)) continue;
+                has_child = 1;
+                if (t->state == TASK_ZOMBIE) {
+                    int child_pid = t->pid;
+                    int code = t->exit_code;
+                    pid_remove(t);
+                    // 它可能还没完全切走，交给 reap_zombies 在 on_cpu 清零后释放
+                    t->next = zombie_list;
+                    zombie_list = t;
+                    spin_unlock(&proc_lock);
+                    // exit_code 是用户指针，写它可能触发 COW 缺页，必须在锁外写
+                    if (exit_code) *exit_code = code;
+                    return child_pid;
+                }
+            }
+        }
+        if (!has_child) {
+            spin_unlock(&proc_lock);
+            return -1;
+        }
+        sleep_locked(self);
+    }
+}
 
-int uvm_copy(pagetable_t old_pt, pagetable_t new_pt, uint64_t sz);
-pagetable_t uvm_create(); // paging.c
+int uvm_copy(pagetable_t old_pt, pagetable_t new_pt);
 
-int pid_counter = 1;        // pid 分配器  递增形式
-int alloc_pid() { return pid_counter++; }
-#define USER_SPACE_SIZE 0x30000
+// 用名为 name 的应用替换当前进程的地址空间 (name 必须是内核缓冲区)
+// 成功时 Trap 上下文已经指向新程序的入口，返回 0；失败时进程不受影响，返回 -1
+int task_exec(char *name) {
+    TaskControlBlock *t = mycpu()->current;
 
-// 返回子进程的 PID
-int task_fork() {
-    // 1. 寻找一个空闲的 TCB
-    int child_id = -1;
-    for (int i = 0; i < MAX_APP_NUM; i++) {
-        if (tasks[i].is_running == 0) { // 0 表示空闲/已死
-            child_id = i;
-            break;
+    char *elf;
+    uint64_t size;
+    if (app_find(name, &elf, &size) < 0) return -1;
+
+    // 先在一旁建好新地址空间，失败了旧的还能继续用
+    // (load_image 成功时才会覆盖 t 的 VMA)
+    pagetable_t new_pt;
+    uint64_t entry = load_image(t, elf, size, &new_pt);
+    if (entry == 0) return -1;
+
+    // 换上新页表，重新分配 ASID (旧 ASID 的 TLB 表项不会再被用到)
+    pagetable_t old_pt = t->pagetable;
+    t->pagetable = new_pt;
+    t->asid_gen = 0;
+    switch_satp(mycpu(), t);
+    uvm_free(old_pt);
+    // 队列页随旧地址空间一起释放了，新程序要用得重新 setup
+    t->uring = 0;
+    t->uring_flags = 0;
+
+    init_user_cx(task_trap_cx(t), entry);
+    return 0;
+}
+
+static Vma* find_vma(TaskControlBlock *t, uint64_t va) {
+    for (Vma *v = t->vmas; v; v = v->next) {
+        if (va >= v->start && va < v->end) return v;
+    }
+    return 0;
+}
+
+static Vma* find_vma_flags(TaskControlBlock *t, int flags) {
+    for (Vma *v = t->vmas; v; v = v->next) {
+        if (v->flags & flags) return v;
+    }
+    return 0;
+}
+
+// 缺页处理 (scause 12/13/15)
+// 1. 写一个 COW 页：复制 (或者最后一个使用者直接恢复可写)
+// 2. 地址在某个 VMA 里但还没映射：分配清零页
+// 3. 地址在栈 VMA 下方、没超过栈上限：栈向下扩展，再按 2 处理
+// 返回 0 表示已处理，-1 表示非法访问
+int task_page_fault(uint64_t scause, uint64_t va) {
+    TaskControlBlock *t = mycpu()->current;
+    if (t == 0 || va >= USER_TOP) return -1;
+
+    if (scause == 15 && uvm_cow_fault(t->pagetable, va) == 0) {
+        t->faults_cow++;
+        return 0;
+    }
+
+    va = va & ~(uint64_t)(PAGE_SIZE - 1);
+    Vma *v = find_vma(t, va);
+    if (v == 0) {
+        Vma *stack = find_vma_flags(t, VMA_STACK);
+        Vma *heap = find_vma_flags(t, VMA_HEAP);
+        // 栈和堆之间至少留一页空洞
+        if (stack == 0 || va >= stack->start || va < USER_STACK_LIMIT ||
+            (heap && va < heap->end + PAGE_SIZE)) {
+            return -1;
         }
+        stack->start = va;
+        t->faults_stack++;
+        v = stack;
     }
-    if (child_id == -1) {
-        printf("[Kernel] No free task slot for fork!\n");
+
+    // 权限不够 (写只读段、执行数据段) 不是缺页能修好的
+    if ((scause == 15 && !(v->perm & PTE_W)) || (scause == 12 && !(v->perm & PTE_X))) {
+        return -1;
+    }
+
+    uint64_t *pte = walk(t->pagetable, va, 0);
+    if (pte && (*pte & PTE_V)) return -1;   // 已经映射了，是权限错误
+
+    void *pa = frame_alloc();
+    if (pa == 0) return -1;
+    // 中间页表也分配不到：和分配不到数据页一样，这次缺页修不好，进程会被杀掉
+    if (uvm_map(t->pagetable, va, (uint64_t)pa, PAGE_SIZE, v->perm) != 0) {
+        frame_dealloc(pa);
+        return -1;
+    }
+    // 原来无效的 PTE 不会进 TLB，不需要刷新
+    t->faults_zero++;
+    return 0;
+}
+
+// 调整堆顶，addr 为 0 时只查询；返回调整后的堆顶 (失败时堆顶不变)
+// 扩展只改 VMA，用到时才分配；收缩时马上释放多出来的页
+uint64_t task_brk(uint64_t addr) {
+    TaskControlBlock *t = mycpu()->current;
+    Vma *heap = find_vma_flags(t, VMA_HEAP);
+    if (heap == 0 || addr == 0) return t->brk;
+
+    Vma *stack = find_vma_flags(t, VMA_STACK);
+    uint64_t new_end = (addr + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    // 不能低于堆的起点，也不能伸进栈能扩展到的范围
+    if (addr < heap->start || new_end > USER_STACK_LIMIT - PAGE_SIZE || new_end > VDSO_DATA_VA ||
+        (stack && new_end > stack->start - PAGE_SIZE)) {
+        return t->brk;
+    }
+
+    if (new_end < heap->end) {
+        uvm_unmap(t->pagetable, new_end, (heap->end - new_end) / PAGE_SIZE);
+    }
+    heap->end = new_end;
+    t->brk = addr;
+    return t->brk;
+}
+
+// 当前进程的提交/完成队列 (uring.c 使用)
+pagetable_t task_pagetable() {
+    return mycpu()->current->pagetable;
+}
+
+void* task_get_uring(int *flags) {
+    TaskControlBlock *t = mycpu()->current;
+    *flags = t->uring_flags;
+    return t->uring;
+}
+
+void task_set_uring(void *ring, int flags) {
+    TaskControlBlock *t = mycpu()->current;
+    t->uring = ring;
+    t->uring_flags = flags;
+}
+
+// 把当前进程的缺页计数写进 out[0..2] (内核缓冲区)：清零页、COW、栈扩展
+void task_fault_stats(uint64_t *out) {
+    TaskControlBlock *t = mycpu()->current;
+    out[0] = t->faults_zero;
+    out[1] = t->faults_cow;
+    out[2] = t->faults_stack;
+}
+
+#ifdef FAULT_INJECT
+// 让当前进程的下一次 fork 在复制完地址空间之后失败 (泄漏检查用)
+void task_fail_next_fork() {
+    mycpu()->current->fail_next_fork = 1;
+}
+#endif
+
+// fork 中途失败：子进程还没运行过，释放已经复制的页表和 TCB
+// 父进程被降成 COW 的页引用计数回到 1，下次写时直接恢复可写
+static void fork_undo(TaskControlBlock *child) {
+    if (child->pagetable) uvm_free(child->pagetable);
+    spin_lock(&proc_lock);
+    pid_remove(child);
+    nr_tasks--;
+    spin_unlock(&proc_lock);
+    tcb_free(child);
+}
+
+// 返回子进程的 PID
+int task_fork() {
+    TaskControlBlock *parent = mycpu()->current;
+
+    // 1. 分配一个新的 TCB
+    TaskControlBlock *child = tcb_alloc();
+    if (child == 0) {
+        klog(LOG_ERR, "[Kernel] No memory for fork!");
         return -1;
     }
-    
-    TaskControlBlock *parent = &tasks[current_task_id];
-    TaskControlBlock *child = &tasks[child_id];
     
     // 2. 创建子进程页表
+    // uvm_create 已经链接好了内核映射
     child->pagetable = uvm_create();
-    // 复制内核映射
-    my_memcpy(child->pagetable, kernel_pagetable, PAGE_SIZE);
-    
+    if (child->pagetable == 0) {
+        klog(LOG_ERR, "[Kernel] No memory for fork page table!");
+        fork_undo(child);
+        return -1;
+    }
+
     // 3. 【核心】复制用户地址空间 (代码段 + 栈)
-    // 从父进程页表复制到子进程页表
-    if (uvm_copy(parent->pagetable, child->pagetable, USER_SPACE_SIZE) < 0) {
-        printf("[Kernel] Fork failed: Memory copy error\n");
+    // 从父进程页表复制到子进程页表 (写时复制，只共享不拷贝)
+    // vDSO 的进程页 (PID) 不能和父进程共享，换成子进程自己的
+    // 地址空间的布局 (VMA、堆顶) 和父进程一样，还没碰过的页在子进程里同样按需分配
+    int ok = uvm_copy(parent->pagetable, child->pagetable) == 0 &&
+             vdso_fork(child->pagetable, child->pid) == 0;
+    for (Vma *v = parent->vmas; ok && v; v = v->next) {
+        ok = vma_add(&child->vmas, v->start, v->end, v->perm, v->flags) == 0;
+    }
+#ifdef FAULT_INJECT
+    if (ok && parent->fail_next_fork) {
+        parent->fail_next_fork = 0;
+        ok = 0;
+    }
+#endif
+    if (!ok) {
+        klog(LOG_ERR, "[Kernel] Fork failed: Memory copy error");
+        fork_undo(child);
         return -1;
     }
-    
+    child->brk = parent->brk;
+
+    // 队列页不继承：子进程自己的 uring 还没建立，把复制过去的映射拿掉
+    // 这一页的引用计数回到 1，父进程下次写它时走 COW 的"直接恢复可写"分支，内核手里的地址不变
+    if (parent->uring) uvm_unmap(child->pagetable, URING_VA, 1);
+
     // 4. 复制 Trap 上下文
     // 子进程的 TrapContext 就在它的内核栈顶
-    uint64_t kstack_top = (uint64_t)&child->kernel_stack[PAGE_SIZE/8];
-    // 初始化 switch 上下文
-    child->context.ra = (uint64_t)__restore_to_user;
-    child->context.sp = kstack_top;
-    
-    // 定位 TrapContext
-    typedef struct {
-        uint64_t x[32];
-        uint64_t sstatus;
-        uint64_t sepc;
-    } TrapContext;
-    
-    kstack_top -= sizeof(TrapContext);
-    TrapContext *child_cx = (TrapContext *)kstack_top;
-    TrapContext *parent_cx = (TrapContext *)(parent->context.sp); // 父进程当前的 TrapContext
-    
-    // 修正 child->context.sp 指向 TrapContext 底部
-    child->context.sp = kstack_top;
+    // 父进程当前的 TrapContext 也固定在它的内核栈顶
+    // (parent->context.sp 是它上一次被切走时的栈指针，不一定指向 TrapContext)
+    TrapContext *child_cx = task_trap_cx(child);
+    TrapContext *parent_cx = task_trap_cx(parent);
+
+    // 初始化 switch 上下文，第一次调度时经 __task_entry 返回用户态
+    child->context.ra = (uint64_t)__task_entry;
+    child->context.sp = (uint64_t)child_cx;
     
     // 直接内存拷贝 TrapContext
     *child_cx = *parent_cx;
 
-    //【新增】帮子进程跳过 ecall 指令！
+    // 父进程的 sepc 在分发 sys_fork 前已经跳过了 ecall (trap.c)，子进程拷过来的也一样
     // 否则它醒来后会再次执行 sys_fork，导致无限递归
-    child_cx->sepc += 4; 
     
     // 5. 【关键】修改子进程的返回值
     // fork 对子进程返回 0
     child_cx->x[10] = 0; // x10 是 a0 寄存器
     
-    // 6. 激活子进程
-    child->is_running = 1;
+    // 6. 激活子进程，新任务从最高优先级开始
+    // 新的地址空间，第一次被调度时再分配 ASID
+    child->asid_gen = 0;
+    child->parent = parent;
+    trace_event(TR_FORK, parent->pid, child->pid);
+    make_ready(cpuid(), child);
     
-    // 7. 返回子进程 PID 给父进程 暂时用数组索引当 PID
-    return child_id; // 或者 return alloc_pid();
-}
\ No newline at end of file
+    // 7. 返回子进程 PID 给父进程
+    return child->pid;
+}
+
+// --- 多核启动 ---
+
+long sbi_hart_start(uint64_t hartid, uint64_t start_addr, uint64_t opaque);
+extern char _secondary_start[];
+
+// 启动 hart 调用：唤醒其他 hart，让它们从 _secondary_start 进入内核
+void task_start_harts() {
+    int self = cpuid();
+    cpus[self].hartid = self;
+    int started = 1;
+    for (int i = 0; i < NCPU; i++) {
+        cpus[i].hartid = i;
+        if (i == self) continue;
+        // 不存在的 hart 会返回错误
+        if (sbi_hart_start(i, (uint64_t)_secondary_start, 0) == 0) started++;
+    }
+    printf("[Kernel] %d harts started\n", started);
+}
@@ -0,0 +1,292 @@
+// os/timer.c
+// 时钟中断：抢占式调度的时间片 + 睡眠用的分层时间轮
+//
+// 无节拍 (tickless)：每个 hart 只在需要的时候才设定时钟中断
+//   - 在跑任务时：时间片到期 (抢占)
+//   - 时间轮里最早的定时器到期 (唤醒睡眠的任务)
+// 两者取早的那个；idle 时没有时间片，没有定时器就干脆不设，hart 一直 wfi 到有事为止
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void sbi_set_timer(uint64_t stime_value);
+int cpuid();
+void vdso_tick();
+
+#ifndef NCPU
+#define NCPU 8
+#endif
+
+// QEMU virt 平台的 timebase 频率 (mtime 每秒增加的次数)
+#define CLOCK_FREQ 10000000
+
+// 时间片长度 (毫秒)，可以在编译时通过 make TIME_SLICE_MS=xx 修改
+#ifndef TIME_SLICE_MS
+#define TIME_SLICE_MS 10
+#endif
+
+#define TICKS_PER_SLICE (CLOCK_FREQ / 1000 * TIME_SLICE_MS)
+
+#define SIE_SSIE (1L << 1)
+#define SIE_STIE (1L << 5)
+
+#define NEVER ((uint64_t)-1)
+
+uint64_t ticks = 0;             // 时钟中断次数 (所有 hart 合计)
+uint64_t idle_sleeps = 0;       // idle 时没有任何定时器、不设时钟中断直接 wfi 的次数
+uint64_t next_deadline[NCPU];   // 每个 hart 下一次时钟中断的时间
+uint64_t slice_deadline[NCPU];  // 当前时间片的结束时间，0 表示 hart 在 idle、不需要时间片
+
+// --- 调度延迟统计 (单位: timebase tick, 10MHz 下 1 tick = 0.1us) ---
+// irq_late:  时钟中断实际进入 trap_handler 的时间 - 设定的 deadline
+// dispatch:  进入 trap_handler 到下一个任务真正被切换上 CPU 的时间
+uint64_t lat_count = 0;
+uint64_t irq_late_total = 0, irq_late_max = 0;
+uint64_t dispatch_total = 0, dispatch_max = 0;
+uint64_t last_irq_time[NCPU];   // 每个 hart 最近一次时钟中断进入的时间
+uint64_t last_irq_late[NCPU];
+
+uint64_t r_time() {
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+// --- 分层时间轮 ---
+// 精度 1ms (一个 jiffy)，三级各 64 个槽：
+//   第 0 级每槽 1ms，覆盖 64ms；第 1 级每槽 64ms，覆盖约 4s；第 2 级每槽约 4s，覆盖约 4.6 分钟
+// 更远的定时器先放在第 2 级最远的槽里，转到时再重新分配 (只会到期偏早，不会漏掉)
+// 高一级的槽在低一级转完一圈时整体"降级"重新插入 (cascade)
+// 每个 hart 一个轮子：定时器加在当前 hart 上，也只由这个 hart 的时钟中断处理，内核里关着中断，不用加锁
+#define JIFFY (CLOCK_FREQ / 1000)
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 3
+
+typedef struct Timer {
+    uint64_t expires;           // 到期时间 (jiffy)
+    void (*fn)(void *arg);      // 到期时在时钟中断里调用
+    void *arg;
+    struct Timer *next;
+} Timer;
+
+typedef struct {
+    uint64_t now;               // 已经处理到的 jiffy
+    uint64_t next_expiry;       // 最早到期的定时器 (jiffy)，NEVER 表示轮子是空的
+    int count;
+    Timer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+} TimerWheel;
+
+TimerWheel wheels[NCPU];
+uint64_t timers_fired = 0;
+
+static void wheel_insert(TimerWheel *w, Timer *t) {
+    uint64_t delta = t->expires - w->now;
+    int level, idx;
+    if (delta < WHEEL_SIZE) {
+        level = 0;
+        idx = t->expires & WHEEL_MASK;
+    } else if (delta < WHEEL_SIZE * WHEEL_SIZE) {
+        level = 1;
+        idx = (t->expires >> WHEEL_BITS) & WHEEL_MASK;
+    } else {
+        uint64_t e = t->expires;
+        uint64_t max = w->now + ((uint64_t)WHEEL_SIZE * WHEEL_SIZE * WHEEL_SIZE - 1);
+        if (e > max) e = max;
+        level = 2;
+        idx = (e >> (2 * WHEEL_BITS)) & WHEEL_MASK;
+    }
+    t->next = w->slots[level][idx];
+    w->slots[level][idx] = t;
+}
+
+// 把高一级的一个槽整体取下来，按离现在的距离重新插入
+static void wheel_cascade(TimerWheel *w, int level, int idx) {
+    Timer *t = w->slots[level][idx];
+    w->slots[level][idx] = 0;
+    while (t) {
+        Timer *nx = t->next;
+        wheel_insert(w, t);
+        t = nx;
+    }
+}
+
+// 重新算最早的到期时间：只在有定时器到期之后做一次，遍历所有槽
+static void wheel_update_next(TimerWheel *w) {
+    w->next_expiry = NEVER;
+    if (w->count == 0) return;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int i = 0; i < WHEEL_SIZE; i++) {
+            for (Timer *t = w->slots[l][i]; t; t = t->next) {
+                if (t->expires < w->next_expiry) w->next_expiry = t->expires;
+            }
+        }
+    }
+}
+
+// 把轮子转到 now_jiffy，返回到期的定时器链表 (由调用者在放下轮子之后逐个回调)
+static Timer* wheel_advance(TimerWheel *w, uint64_t now_jiffy) {
+    Timer *expired = 0;
+    if (w->count == 0) {
+        // 空轮子直接跳过去，idle 很久之后不用一格一格地转
+        w->now = now_jiffy;
+        return 0;
+    }
+    while (w->now < now_jiffy) {
+        w->now++;
+        if ((w->now & (WHEEL_SIZE * WHEEL_SIZE - 1)) == 0) {
+            wheel_cascade(w, 2, (w->now >> (2 * WHEEL_BITS)) & WHEEL_MASK);
+        }
+        if ((w->now & WHEEL_MASK) == 0) {
+            wheel_cascade(w, 1, (w->now >> WHEEL_BITS) & WHEEL_MASK);
+        }
+
+        int idx = w->now & WHEEL_MASK;
+        Timer **pp = &w->slots[0][idx];
+        while (*pp) {
+            Timer *t = *pp;
+            if (t->expires <= w->now) {
+                *pp = t->next;
+                t->next = expired;
+                expired = t;
+                w->count--;
+            } else {
+                pp = &t->next;
+            }
+        }
+    }
+    if (expired) wheel_update_next(w);
+    return expired;
+}
+
+// 设定本 hart 的下一次时钟中断：时间片结束和最早的定时器取早的
+static void timer_program(int id) {
+    uint64_t d = slice_deadline[id] ? slice_deadline[id] : NEVER;
+    TimerWheel *w = &wheels[id];
+    if (w->next_expiry != NEVER && w->next_expiry * JIFFY < d) d = w->next_expiry * JIFFY;
+
+    // 已经设好了同一个时间就不再 ecall 一次
+    if (d == next_deadline[id]) return;
+    next_deadline[id] = d;
+    sbi_set_timer(d);
+}
+
+// 在当前 hart 上加一个定时器，deadline 是 rdtime 的值，到期时在时钟中断里调用 fn(arg)
+// 调用者关着中断 (内核态一直是关的)
+void timer_add(Timer *t, uint64_t deadline, void (*fn)(void *), void *arg) {
+    int id = cpuid();
+    TimerWheel *w = &wheels[id];
+
+    // 空轮子在无节拍 idle 时不转，now 可能是几小时前的；先拨到现在，
+    // 否则下一次时钟中断里 wheel_advance 要关着中断一格一格地补完这段时间
+    // (和 wheel_advance 对空轮子的处理一样)
+    if (w->count == 0) w->now = r_time() / JIFFY;
+
+    // 向上取整到 jiffy，不会早醒；至少是下一个 jiffy (当前这格已经处理过了)
+    t->expires = (deadline + JIFFY - 1) / JIFFY;
+    if (t->expires <= w->now) t->expires = w->now + 1;
+    t->fn = fn;
+    t->arg = arg;
+
+    wheel_insert(w, t);
+    w->count++;
+    if (t->expires < w->next_expiry) w->next_expiry = t->expires;
+    timer_program(id);
+}
+
+// 打开 S 态时钟中断和软件中断 (核间中断，见 task.c 的 kick_idle_hart)，设定第一个时间片
+void timer_init() {
+    uint64_t sie;
+    asm volatile("csrr %0, sie" : "=r"(sie));
+    sie |= SIE_STIE | SIE_SSIE;
+    asm volatile("csrw sie, %0" : : "r"(sie));
+
+    int id = cpuid();
+    uint64_t now = r_time();
+    wheels[id].now = now / JIFFY;
+    wheels[id].next_expiry = NEVER;
+    next_deadline[id] = 0;
+    slice_deadline[id] = now + TICKS_PER_SLICE;
+    timer_program(id);
+    printf("[Kernel] Timer enabled: time slice = %d ms, tickless idle\n", TIME_SLICE_MS);
+}
+
+// idle 循环 wfi 之前调用：没有任务在跑，不需要时间片
+void timer_idle_enter() {
+    int id = cpuid();
+    slice_deadline[id] = 0;
+    if (wheels[id].next_expiry == NEVER) __sync_fetch_and_add(&idle_sleeps, 1);
+    timer_program(id);
+}
+
+// idle 循环要切到任务之前调用：重新开始计时间片
+void timer_idle_exit() {
+    int id = cpuid();
+    if (slice_deadline[id]) return;
+    slice_deadline[id] = r_time() + TICKS_PER_SLICE;
+    timer_program(id);
+}
+
+// 时钟中断处理：记账、处理到期的定时器、设定下一次中断
+// 返回 1 表示时间片用完了 (trap_handler 据此决定是否调用 task_tick)
+// 每个 hart 有自己的时钟中断；合计的统计量用原子加，最大值允许偶尔不准
+int timer_tick() {
+    int id = cpuid();
+    uint64_t now = r_time();
+    uint64_t late = now - next_deadline[id];
+
+    __sync_fetch_and_add(&ticks, 1);
+    vdso_tick();
+    last_irq_time[id] = now;
+    last_irq_late[id] = late;
+    __sync_fetch_and_add(&irq_late_total, late);
+    if (late > irq_late_max) irq_late_max = late;
+
+    int slice_over = 0;
+    if (slice_deadline[id] && now >= slice_deadline[id]) {
+        slice_over = 1;
+        slice_deadline[id] = now + TICKS_PER_SLICE;
+    }
+
+    Timer *expired = wheel_advance(&wheels[id], now / JIFFY);
+    // 已经触发过的 deadline 作废，下面一定会重新设定
+    next_deadline[id] = 0;
+    timer_program(id);
+
+    while (expired) {
+        Timer *t = expired;
+        expired = t->next;
+        __sync_fetch_and_add(&timers_fired, 1);
+        t->fn(t->arg);
+    }
+    return slice_over;
+}
+
+// 抢占后新任务即将上 CPU 时调用，记录这一次的调度延迟
+void timer_record_dispatch() {
+    int id = cpuid();
+    uint64_t now = r_time();
+    uint64_t d = now - last_irq_time[id];
+
+    __sync_fetch_and_add(&lat_count, 1);
+    __sync_fetch_and_add(&dispatch_total, d);
+    if (d > dispatch_max) dispatch_max = d;
+
+#ifdef SCHED_TRACE
+    printf("[Sched] hart=%d t=%lu irq=%lu dispatch=%lu late=%lu\n",
+           id, now, last_irq_time[id], d, last_irq_late[id]);
+#endif
+}
+
+void timer_stats() {
+    printf("[Kernel] timer: slice=%d ms, ticks=%lu, preemptions=%lu\n", TIME_SLICE_MS, ticks, lat_count);
+    printf("[Kernel] timer: timers fired=%lu, idle sleeps without a deadline=%lu\n", timers_fired, idle_sleeps);
+    if (ticks > 0) {
+        printf("[Kernel] timer: irq late avg=%lu max=%lu (timebase ticks)\n",
+               irq_late_total / ticks, irq_late_max);
+    }
+    if (lat_count > 0) {
+        printf("[Kernel] timer: dispatch avg=%lu max=%lu (timebase ticks)\n",
+               dispatch_total / lat_count, dispatch_max);
+    }
+}
@@ -0,0 +1,138 @@
+// os/trace.c
+// 内核事件追踪：每个 hart 一个二进制环形缓冲区，记录 Trap、系统调用、任务切换、
+// 物理页分配/回收、fork 和缺页，带 rdtime / rdcycle 时间戳
+//
+// 开销：
+//   编译时 make TRACE=0 时 trace_event() 是空函数
+//   运行时默认关闭，trace_event() 只读一次 trace_on 就返回
+//   打开时每个事件写 32 字节，不加锁 (只写本 hart 的缓冲区，内核态不开中断)
+//
+// 导出：sys_trace(TRACE_DUMP) 把缓冲区按文本格式打到串口，
+//       tools/trace_report.py 从串口日志里解析出延迟直方图和时间线
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+int cpuid();
+int task_current_pid();
+
+#ifndef NCPU
+#define NCPU 8
+#endif
+
+// 事件类型 (和 tools/trace_report.py 里的名字一一对应)
+#define TR_TRAP_ENTER   1   // a = scause, b = sepc
+#define TR_TRAP_EXIT    2   // a = scause, b = 耗时 (timebase tick)
+#define TR_SYSCALL      3   // a = 系统调用号, b = 耗时
+#define TR_SWITCH       4   // a = 切出的 pid, b = 切入的 pid (0 表示 idle)
+#define TR_FRAME_ALLOC  5   // a = 物理地址, b = 1 表示来自清零页池
+#define TR_FRAME_FREE   6   // a = 物理地址, b = 剩余引用数 (0 表示真正释放)
+#define TR_FORK         7   // a = 父 pid, b = 子 pid
+#define TR_PAGE_FAULT   8   // a = 出错地址, b = 处理结果 (0 成功)
+
+// sys_trace 的命令
+#define TRACE_OFF   0
+#define TRACE_ON    1
+#define TRACE_DUMP  2
+#define TRACE_CLEAR 3
+
+#define TRACE_ENTRIES 512   // 每个 hart 的事件数 (2 的幂)
+
+typedef struct {
+    uint64_t time;      // rdtime
+    uint64_t cycle;     // rdcycle
+    uint16_t type;
+    uint16_t pid;
+    uint64_t a;
+    uint64_t b;
+} TraceEvent;
+
+typedef struct {
+    uint64_t head;      // 下一个写入的位置 (只增不减)
+    TraceEvent ev[TRACE_ENTRIES];
+} TraceRing;
+
+TraceRing trace_rings[NCPU];
+volatile int trace_on = 0;
+
+#ifdef TRACE
+static char *trace_names[] = {
+    "?", "trap_enter", "trap_exit", "syscall", "switch",
+    "frame_alloc", "frame_free", "fork", "page_fault",
+};
+#endif
+
+void trace_event(int type, uint64_t a, uint64_t b) {
+#ifdef TRACE
+    if (!trace_on) return;
+
+    TraceRing *ring = &trace_rings[cpuid()];
+    TraceEvent *e = &ring->ev[ring->head % TRACE_ENTRIES];
+    uint64_t t, cyc;
+    asm volatile("rdtime %0" : "=r"(t));
+    asm volatile("rdcycle %0" : "=r"(cyc));
+    e->time = t;
+    e->cycle = cyc;
+    e->type = type;
+    e->pid = task_current_pid();
+    e->a = a;
+    e->b = b;
+    ring->head++;
+#endif
+}
+
+#ifdef TRACE
+// 按 hart 把缓冲区打到串口，每个 hart 从最旧的事件打到最新的
+// 时间用相对 base 的差值 (所有 hart 里最早的事件为 0)
+// 每行: T <hart> <time> <cycle> <事件名> <pid> <a> <b>，cycle / a / b 是十六进制
+static void trace_dump() {
+    int was_on = trace_on;
+    trace_on = 0;
+
+    // 所有 hart 共用一个时间基准，方便工具把它们合成一条时间线
+    uint64_t base = ~0UL;
+    for (int h = 0; h < NCPU; h++) {
+        TraceRing *ring = &trace_rings[h];
+        if (ring->head == 0) continue;
+        uint64_t first = ring->head > TRACE_ENTRIES ? ring->head - TRACE_ENTRIES : 0;
+        if (ring->ev[first % TRACE_ENTRIES].time < base) {
+            base = ring->ev[first % TRACE_ENTRIES].time;
+        }
+    }
+
+    printf("TRACE-BEGIN freq=10000000\n");
+    for (int h = 0; h < NCPU; h++) {
+        TraceRing *ring = &trace_rings[h];
+        uint64_t first = ring->head > TRACE_ENTRIES ? ring->head - TRACE_ENTRIES : 0;
+        for (uint64_t i = first; i < ring->head; i++) {
+            TraceEvent *e = &ring->ev[i % TRACE_ENTRIES];
+            char *name = e->type < sizeof(trace_names) / sizeof(trace_names[0]) ? trace_names[e->type] : "?";
+            printf("T %d %lu %lx %s %d %lx %lx\n",
+                   h, e->time - base, e->cycle, name, e->pid, e->a, e->b);
+        }
+    }
+    printf("TRACE-END\n");
+
+    trace_on = was_on;
+}
+#endif
+
+// 系统调用入口，返回 0 表示成功
+int sys_trace(int cmd) {
+#ifndef TRACE
+    printf("[Kernel] trace: not compiled in (build with TRACE=1)\n");
+    return -1;
+#else
+    if (cmd == TRACE_OFF) {
+        trace_on = 0;
+    } else if (cmd == TRACE_ON) {
+        trace_on = 1;
+    } else if (cmd == TRACE_DUMP) {
+        trace_dump();
+    } else if (cmd == TRACE_CLEAR) {
+        for (int h = 0; h < NCPU; h++) trace_rings[h].head = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+#endif
+}
@@ -2,79 +2,305 @@
 
 // 引用外部函数
 void printf(char *fmt, ...);
-void console_putchar(int c);
-void task_exit();
+void console_write(char *buf, uint64_t len);
+void task_exit(int code);
 void task_yield();
-long console_getchar();
+void task_tick();
+uint64_t sys_uring_setup(int flags);
+int sys_uring_enter();
+void uring_poll();
+void task_io_boost();
+int timer_tick();
+int tty_read(char *buf, int len);
+int tty_set_raw(int raw);
+void uart_intr();
+int plic_claim();
+void plic_complete(int irq);
 int task_fork();
+#ifdef FAULT_INJECT
+void task_fail_next_fork();
+#endif
+int task_current_pid();
+int task_exec(char *name);
+int task_page_fault(uint64_t scause, uint64_t va);
+uint64_t task_brk(uint64_t addr);
+void task_sleep_until(uint64_t deadline);
+void task_fault_stats(uint64_t *out);
+void sbi_shutdown();
+uint64_t mm_available_pages();
+int64_t string_bench(int op, int variant);
+int sys_dmesg(char *buf, int len);
+void klog(int level, char *fmt, ...);
+#define LOG_ERR 3
+#define LOG_WARN 4
+int task_waitpid(int pid, int *exit_code);
+typedef uint64_t* pagetable_t;
+
+void trace_event(int type, uint64_t a, uint64_t b);
+int sys_trace(int cmd);
+extern volatile int trace_on;
+uint64_t r_time();
+
+// 追踪事件类型 (见 trace.c)
+#define TR_TRAP_ENTER   1
+#define TR_TRAP_EXIT    2
+#define TR_SYSCALL      3
+#define TR_PAGE_FAULT   8
+
+#define UART0_IRQ 10
+
+// ioctl 命令：arg 非 0 进入 raw 模式，0 回到 cooked 模式，返回之前的模式
+#define TTY_IOCTL_SETRAW 1
+int uvm_cow_fault(pagetable_t pagetable, uint64_t va);
 
 typedef struct {
     uint64_t x[32];
     uint64_t sstatus;
     uint64_t sepc;
+    uint64_t kernel_tp;     // 本 hart 的 hartid，回用户态前由 __restore 填写
+    uint64_t reserved;
 } TrapContext;
 
+// --- 系统调用 ---
+// 每个调用号对应一个处理函数，参数从 cx->x[10..] (a0..a2) 取，返回值写回 a0
+// 分发前 sepc 已经推进到 ecall 的下一条，处理函数里睡眠、切走再回来都不用再管它
+//
+// SC_FAST：不会切换任务、不会杀掉进程 (内核态缺页除外，它在原地处理完就返回)
+// 这类调用从 trap_entry.S 的快速路径进来：只保存了 C 调用约定里调用者保存的寄存器、
+// sstatus 和 sepc，s0..s11 和 gp 在 TrapContext 里是旧值，处理函数不能去读
+// 其余的调用需要完整的 TrapContext (fork 要拷贝、exec 要重置、切走的任务要原样恢复)
+typedef uint64_t (*syscall_fn)(TrapContext *cx);
+
+typedef struct {
+    syscall_fn fn;
+    int flags;
+} SyscallEntry;
+
+#define SC_FAST 1
+#define NR_SYSCALLS 427
+
+// 用户空间的上界 (和 task.c 保持一致)，内核的恒等映射在它上面
+#define USER_TOP 0x80000000L
+
+// 系统调用传进来的用户缓冲区 [va, va + len) 必须整个在用户空间里 (不溢出、不超过 USER_TOP)
+// 不检查的话内核会替用户读写内核地址；范围对了但没映射的地址由缺页处理，修不好就杀掉进程
+static int user_range_ok(uint64_t va, uint64_t len) {
+    return va < USER_TOP && len <= USER_TOP - va;
+}
+
+static uint64_t do_write(TrapContext *cx) {
+    char *buf = (char *)cx->x[11];
+    uint64_t len = cx->x[12];
+    if (!user_range_ok((uint64_t)buf, len)) return -1;
+    // 拷进内核缓冲区后成批交给固件，不再每个字节一次 ecall
+    console_write(buf, len);
+    return len;
+}
+
+static uint64_t do_exit(TrapContext *cx) {
+    task_exit((int)cx->x[10]);
+    return 0;
+}
+
+static uint64_t do_yield(TrapContext *cx) {
+    task_yield();
+    return 0;
+}
+
+static uint64_t do_read(TrapContext *cx) {
+    uint64_t fd = cx->x[10];
+    char *buf = (char *)cx->x[11];
+    uint64_t len = cx->x[12];
+
+    // 只支持标准输入(fd=0)
+    if (fd != 0 || len == 0) return 0;
+    if (!user_range_ok((uint64_t)buf, len)) return -1;
+
+    // 没有输入时在 TTY 里睡眠，CPU 让给其他任务 (或者 idle 真正 wfi)
+    // cooked 模式下一次返回一整行，回显和退格已经在内核里处理过了
+    char kbuf[128];
+    int n = tty_read(kbuf, len < sizeof(kbuf) ? len : sizeof(kbuf));
+    // 放开 TTY 锁以后再写用户缓冲区 (可能触发 COW 缺页)
+    for (int i = 0; i < n; i++) buf[i] = kbuf[i];
+    // 等到了输入，说明是交互型任务，提回最高优先级
+    task_io_boost();
+    return n;
+}
+
+static uint64_t do_fork(TrapContext *cx) {
+    return task_fork();
+}
+
+// sys_ioctl(fd, cmd, arg)，目前只有 TTY 的 raw 开关
+static uint64_t do_ioctl(TrapContext *cx) {
+    if (cx->x[10] == 0 && cx->x[11] == TTY_IOCTL_SETRAW) return tty_set_raw((int)cx->x[12]);
+    return -1;
+}
+
+// sys_nanosleep(&req, &rem)：req 是 {秒, 纳秒}，睡够了才返回，rem 不会被用到 (睡眠不会被打断)
+#define CLOCK_FREQ 10000000
+
+static uint64_t do_nanosleep(TrapContext *cx) {
+    int64_t *req = (int64_t *)cx->x[10];
+    if (!user_range_ok((uint64_t)req, 2 * sizeof(int64_t))) return -1;
+    int64_t sec = req[0], nsec = req[1];
+    if (sec < 0 || nsec < 0 || nsec >= 1000000000) return -1;
+    // sec 很大时 sec * CLOCK_FREQ 会溢出，deadline 绕回到过去就马上返回了
+    // 封顶到离 64 位时钟回绕还差 2 秒 (timer_add 还要向上取整到 jiffy)，相当于睡到永远
+    uint64_t now = r_time();
+    uint64_t max_sec = (~0UL - now) / CLOCK_FREQ - 2;
+    if ((uint64_t)sec > max_sec) sec = max_sec;
+    task_sleep_until(now + sec * CLOCK_FREQ + nsec / (1000000000 / CLOCK_FREQ));
+    return 0;
+}
+
+static uint64_t do_getpid(TrapContext *cx) {
+    return task_current_pid();
+}
+
+// 关机 (跑分程序跑完后退出 QEMU)
+static uint64_t do_shutdown(TrapContext *cx) {
+    printf("[Kernel] Shutdown requested by pid %d\n", task_current_pid());
+    sbi_shutdown();
+    return 0;
+}
+
+// sys_trace(cmd)：开/关/导出/清空事件追踪
+static uint64_t do_trace(TrapContext *cx) {
+    return sys_trace((int)cx->x[10]);
+}
+
+// sys_exec(name)：换成应用表里名为 name 的程序
+static uint64_t do_exec(TrapContext *cx) {
+    // 先把名字拷进内核，旧地址空间马上就要被释放
+    char *uname = (char *)cx->x[10];
+    char name[32];
+    int i = 0;
+    // 名字的长度事先不知道，每读一个字节前检查它还在用户空间里
+    while (i < sizeof(name) - 1 && user_range_ok((uint64_t)uname, i + 1) && uname[i]) {
+        name[i] = uname[i];
+        i++;
+    }
+    name[i] = '\0';
+    if (task_exec(name) < 0) return -1;
+    // 成功时 cx 已经被重置成新程序的入口，a0 保持原样
+    return cx->x[10];
+}
+
+// sys_brk(addr)：调整堆顶，addr 为 0 时查询，返回新的堆顶
+static uint64_t do_brk(TrapContext *cx) {
+    return task_brk(cx->x[10]);
+}
+
+// sys_faultstat(out[3])：当前进程的缺页计数
+static uint64_t do_faultstat(TrapContext *cx) {
+    uint64_t st[3];
+    task_fault_stats(st);
+    uint64_t *out = (uint64_t *)cx->x[10];
+    if (!user_range_ok((uint64_t)out, sizeof(st))) return -1;
+    for (int i = 0; i < 3; i++) out[i] = st[i];
+    return 0;
+}
+
+// sys_meminfo()：可用的物理页数 (泄漏检查用)
+static uint64_t do_meminfo(TrapContext *cx) {
+    return mm_available_pages();
+}
+
+// sys_membench(op, variant)：内核里复制 (op=0) / 清零 (op=1) 一页的平均周期数
+// variant：0 按字节，1 按 64 位字，2 RVV；这个版本不可用时返回 -1
+static uint64_t do_membench(TrapContext *cx) {
+    return string_bench((int)cx->x[10], (int)cx->x[11]);
+}
+
+// sys_dmesg(buf, len)：读内核日志环，每行 "<级别>[时间] 内容"，返回字节数
+static uint64_t do_dmesg(TrapContext *cx) {
+    int len = (int)cx->x[11];
+    if (len < 0 || !user_range_ok(cx->x[10], len)) return -1;
+    return sys_dmesg((char *)cx->x[10], len);
+}
+
+#ifdef FAULT_INJECT
+// sys_forkfail()：让本进程的下一次 fork 在复制完地址空间后失败 (测失败路径有没有泄漏)
+// 只在 make FAULT_INJECT=1 时编进来，平常的内核里是未知系统调用，返回 -1
+static uint64_t do_forkfail(TrapContext *cx) {
+    task_fail_next_fork();
+    return 0;
+}
+#endif
+
+// sys_waitpid(pid, &exit_code)，pid = -1 表示任意子进程
+static uint64_t do_waitpid(TrapContext *cx) {
+    // exit_code 可以是 0 (不关心退出码)
+    if (cx->x[11] && !user_range_ok(cx->x[11], sizeof(int))) return -1;
+    return task_waitpid((int)cx->x[10], (int *)cx->x[11]);
+}
+
+// sys_uring_setup(flags)：建立提交/完成队列，返回它的用户地址
+static uint64_t do_uring_setup(TrapContext *cx) {
+    return sys_uring_setup((int)cx->x[10]);
+}
+
+// sys_uring_enter()：处理队列里所有已提交的操作 (其中的 read / yield 可能切走)，返回个数
+static uint64_t do_uring_enter(TrapContext *cx) {
+    return sys_uring_enter();
+}
+
+static const SyscallEntry syscall_table[NR_SYSCALLS] = {
+    [29]  = { do_ioctl,       SC_FAST },
+    [63]  = { do_read,        0 },
+    [64]  = { do_write,       SC_FAST },
+    [93]  = { do_exit,        0 },
+    [101] = { do_nanosleep,   0 },
+    [116] = { do_dmesg,       0 },
+    [124] = { do_yield,       0 },
+    [172] = { do_getpid,      SC_FAST },
+    [214] = { do_brk,         SC_FAST },
+    [220] = { do_fork,        0 },
+    [221] = { do_exec,        0 },
+    [260] = { do_waitpid,     0 },
+    [401] = { do_trace,       SC_FAST },
+    [402] = { do_shutdown,    0 },
+    [404] = { do_faultstat,   SC_FAST },
+    [405] = { do_meminfo,     SC_FAST },
+    [406] = { do_membench,    SC_FAST },
+#ifdef FAULT_INJECT
+    [407] = { do_forkfail,    SC_FAST },
+#endif
+    [425] = { do_uring_setup, SC_FAST },
+    [426] = { do_uring_enter, 0 },
+};
+
+static void syscall_dispatch(TrapContext *cx, syscall_fn fn) {
+    // 没开追踪时不读时钟
+    uint64_t t0 = trace_on ? r_time() : 0;
+    uint64_t syscall_num = cx->x[17];   // exec 成功后 cx 被重置，先记下来
+    cx->sepc += 4;
+    cx->x[10] = fn(cx);
+    if (t0) trace_event(TR_SYSCALL, syscall_num, r_time() - t0);
+}
+
+// 快速路径 (trap_entry.S 在用户态 ecall 时先调用它)：能处理返回 1，
+// 返回 0 时汇编补全 TrapContext 后走 trap_handler
+int syscall_fast(TrapContext *cx) {
+    uint64_t syscall_num = cx->x[17];
+    if (syscall_num >= NR_SYSCALLS || !(syscall_table[syscall_num].flags & SC_FAST)) return 0;
+    syscall_dispatch(cx, syscall_table[syscall_num].fn);
+    return 1;
+}
+
 // 🔴【修改1】让 syscall 也返回 TrapContext*，保持数据流连贯
 TrapContext* syscall(TrapContext *cx) {
     uint64_t syscall_num = cx->x[17];
-
-    if (syscall_num == 64) { // sys_write
-        uint64_t fd = cx->x[10];
-        char *buf = (char *)cx->x[11];
-        uint64_t len = cx->x[12];
-        
-        // 调试打印 (确认指针正常)
-        // printf("[Kernel] sys_write: fd=%d, buf=%x, len=%d\n", fd, buf, len);
-        
-        for(int i=0; i<len; i++) {
-            console_putchar(buf[i]);
-        }
-        
-        cx->x[10] = len;
-        cx->sepc += 4;
-    } 
-    else if (syscall_num == 93) { // sys_exit
-        // printf("[Kernel] Application exited with code %d\n", cx->x[10]);
-        // // 这里的死循环是为了防止跑飞
-        // while(1);
-        // 切换任务
-        printf("[Kernel] App %d exited. \n", cx->x[10]);
-
-        task_exit();
-    } 
-    else if(syscall_num == 124){
-        // 124 常用的 yield 调用号
-        task_yield();
-        cx->sepc += 4;  // 返回后继续执行下一条指令
-    }
-    else if(syscall_num == 63){
-        uint64_t fd = cx->x[10];
-        char *buf = (char *)cx->x[11];
-        uint64_t len = cx->x[12];
-
-        // 只支持标准输入(fd=0)
-        if(fd == 0){
-            long c;
-            while(1){
-                c = console_getchar();
-                if(c != -1) break;
-            }
-            *buf = (char) c;
-            cx->x[10] = 1;
-        }else{
-            cx->x[10] = 0;
-        }
+    if (syscall_num >= NR_SYSCALLS || syscall_table[syscall_num].fn == 0) {
+        // 不认识的调用号 (ENOSYS)：跳过 ecall 返回 -1，不能让用户程序把 hart 卡死
+        klog(LOG_WARN, "[Kernel] Unknown syscall %lu from pid %d", syscall_num, task_current_pid());
         cx->sepc += 4;
+        cx->x[10] = -1;
+        return cx;
     }
-    else if (syscall_num == 220) {  // sys_fork
-        cx->x[10] = task_fork();
-        cx->sepc += 4;
-    }
-    else {
-        printf("[Kernel] Unknown syscall: %d\n", syscall_num);
-        while(1);
-    }
-    
+    syscall_dispatch(cx, syscall_table[syscall_num].fn);
+
     // 🔴【关键】必须返回 cx
     return cx;
 }
@@ -84,21 +310,68 @@ TrapContext* trap_handler(TrapContext *cx) {
     uint64_t scause, stval;
     asm volatile("csrr %0, scause" : "=r"(scause));
     asm volatile("csrr %0, stval" : "=r"(stval));
-    
+    uint64_t t0 = trace_on ? r_time() : 0;
+    if (t0) trace_event(TR_TRAP_ENTER, scause, cx->sepc);
+
     // 判断是不是中断
     if ((scause >> 63) == 1) {
-        // ... (暂不处理)
+        uint64_t code = scause & 0xFF;
+        if (code == 5) {
+            // S 态时钟中断：时间片用完，或者时间轮里有定时器到期 (见 timer.c)
+            int slice_over = timer_tick();
+            // 只抢占用户态 (内核态只有 idle 会开中断)
+            if ((cx->sstatus & (1L << 8)) == 0) {
+                // 轮询模式的进程不用 enter，提交的操作在这里顺便处理
+                uring_poll();
+                if (slice_over) task_tick();
+            }
+        } else if (code == 1) {
+            // S 态软件中断：别的 hart 给我们放了任务，把 idle 从 wfi 里叫醒 (task.c 的 kick_idle_hart)
+            // 回到 idle 循环就会去看就绪队列，这里只需要清掉 SSIP
+            asm volatile("csrc sip, %0" : : "r"(1L << 1));
+        } else if (code == 9) {
+            // S 态外部中断：找 PLIC 领取中断号
+            int irq = plic_claim();
+            if (irq == UART0_IRQ) {
+                uart_intr();
+            } else if (irq) {
+                klog(LOG_WARN, "[Kernel] Unexpected irq %d", irq);
+            }
+            if (irq) plic_complete(irq);
+        }
     } else {
+        // 缺页：写时复制、VMA 里的按需分配、栈扩展 (见 task.c 的 task_page_fault)
+        int is_fault = scause == 12 || scause == 13 || scause == 15;
+        int fault = is_fault ? task_page_fault(scause, stval) : -1;
+        if (is_fault) trace_event(TR_PAGE_FAULT, stval, fault);
+
         if (scause == 8) {
             cx = syscall(cx);
+        } else if (fault == 0) {
+            // 缺页已处理，返回后重新执行那条访存指令
+            // (内核在 sys_read 里写用户缓冲区时也会走到这里)
+        } else if ((cx->sstatus & (1L << 8)) == 0) {
+            // 用户程序的非法访问：只杀掉这个进程
+            klog(LOG_ERR, "[Kernel] App %d killed: scause=%lu stval=%p sepc=%p",
+                   task_current_pid(), scause, stval, cx->sepc);
+            task_exit(-1);
+        } else if (stval < USER_TOP && task_current_pid() != 0) {
+            // 内核替当前进程访问用户地址 (系统调用的缓冲区、轮询模式的提交队列) 时出的错：
+            // 地址在用户空间但缺页修不好 (不在任何 VMA 里)，是进程传了坏指针，只杀掉这个进程
+            // 这次 trap 之下压着的内核栈帧不会再回去了，task_exit 直接切走
+            klog(LOG_ERR, "[Kernel] App %d killed in syscall: scause=%lu stval=%p sepc=%p",
+                 task_current_pid(), scause, stval, cx->sepc);
+            task_exit(-1);
         } else {
             // 🔴【关键】打印详细崩溃信息
             printf("\n[Kernel] PANIC! Exception @ Kernel Mode\n");
-            printf("scause = %d (Exception Type)\n", scause);
-            printf("stval  = %x (Bad Address)\n", stval);
-            printf("sepc   = %x (Instruction Address)\n", cx->sepc);
+            printf("scause = %lu (Exception Type)\n", scause);
+            printf("stval  = %p (Bad Address)\n", stval);
+            printf("sepc   = %p (Instruction Address)\n", cx->sepc);
             while(1);
         }
     }
+    // 耗时包括中途被切走的时间 (yield、睡眠、抢占)
+    if (t0) trace_event(TR_TRAP_EXIT, scause, r_time() - t0);
     return cx;
 }
@@ -0,0 +1,114 @@
+// os/tty.c
+// 控制台的行规程 (line discipline)
+// cooked 模式 (默认)：内核负责回显、退格和行缓冲，一次 sys_read 拿到一整行
+//   以前 readline 每个键都要 sys_read 一次、回显再 sys_write 一次，每键至少两次陷入
+// raw 模式：不回显、不攒行，收到什么就交给 sys_read 什么 (给需要逐键处理的程序用)
+#include <stdint.h>
+
+void console_write(char *buf, uint64_t len);
+
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+void spin_lock(spinlock_t *lk);
+void spin_unlock(spinlock_t *lk);
+void task_sleep(void *chan, spinlock_t *lk);
+void task_wakeup(void *chan);
+
+#define TTY_BUF_SIZE 128
+
+#define BACKSPACE 0x08
+#define DELETE 0x7f
+#define CTRL_U 0x15     // 删除整行
+
+// 环形缓冲区，下标只增不减，取模访问：
+//   [r, w)  已经提交、可以被 sys_read 读走的字符
+//   [w, e)  cooked 模式下正在编辑的一行 (还没敲回车)
+char tty_buf[TTY_BUF_SIZE];
+uint64_t tty_r = 0;
+uint64_t tty_w = 0;
+uint64_t tty_e = 0;
+
+int tty_raw = 0;
+uint64_t tty_dropped = 0;   // 缓冲区满时丢掉的字符数
+
+spinlock_t tty_lock;
+
+static void tty_echo(char *s, int len) {
+    console_write(s, len);
+}
+
+// 收到一个字符 (在 UART 中断里调用)
+void tty_input(int c) {
+    int wake = 0;
+
+    spin_lock(&tty_lock);
+    if (tty_raw) {
+        if (tty_e - tty_r < TTY_BUF_SIZE) {
+            tty_buf[tty_e++ % TTY_BUF_SIZE] = c;
+            tty_w = tty_e;
+            wake = 1;
+        } else {
+            tty_dropped++;
+        }
+    } else if (c == BACKSPACE || c == DELETE) {
+        if (tty_e != tty_w) {
+            tty_e--;
+            tty_echo("\b \b", 3);
+        }
+    } else if (c == CTRL_U) {
+        while (tty_e != tty_w) {
+            tty_e--;
+            tty_echo("\b \b", 3);
+        }
+    } else {
+        if (c == '\r') c = '\n';
+        // 留一个位置给回车，保证一行总能结束
+        if (tty_e - tty_r < TTY_BUF_SIZE - 1 || (c == '\n' && tty_e - tty_r < TTY_BUF_SIZE)) {
+            char ch = c;
+            tty_buf[tty_e++ % TTY_BUF_SIZE] = ch;
+            tty_echo(&ch, 1);
+            if (c == '\n') {
+                tty_w = tty_e;
+                wake = 1;
+            }
+        } else {
+            tty_dropped++;
+        }
+    }
+    spin_unlock(&tty_lock);
+
+    if (wake) task_wakeup(&tty_r);
+}
+
+// 读至多 len 个字符到内核缓冲区 buf，没有可读的内容时睡眠等待
+// cooked 模式下读到换行就停 (一次最多返回一行)，返回实际读到的数量
+// buf 不能是用户指针：持锁时写用户页可能触发 COW 缺页
+int tty_read(char *buf, int len) {
+    int n = 0;
+
+    spin_lock(&tty_lock);
+    while (tty_r == tty_w) {
+        task_sleep(&tty_r, &tty_lock);
+    }
+    while (n < len && tty_r != tty_w) {
+        char c = tty_buf[tty_r++ % TTY_BUF_SIZE];
+        buf[n++] = c;
+        if (c == '\n' && !tty_raw) break;
+    }
+    spin_unlock(&tty_lock);
+    return n;
+}
+
+// 切换 raw / cooked 模式，返回之前的模式
+int tty_set_raw(int raw) {
+    spin_lock(&tty_lock);
+    int old = tty_raw;
+    tty_raw = raw ? 1 : 0;
+    // 切到 raw 时，正在编辑的半行直接交给读者
+    if (tty_raw) tty_w = tty_e;
+    spin_unlock(&tty_lock);
+
+    if (raw) task_wakeup(&tty_r);
+    return old;
+}
@@ -0,0 +1,44 @@
+// os/uart.c
+// 16550 UART 接收驱动：中断把收到的字符交给 tty.c，sys_read 在那边睡眠等待
+// 以前 sys_read 轮询 SBI getchar，等键盘的时候整颗 CPU 都在内核里空转
+// 输出仍然走 console.c (SBI DBCN)，这里只接管接收
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+
+void tty_input(int c);
+
+#define UART0 0x10000000L
+#define MAXVA (1L << 38)
+#define KERNEL_MMIO_BASE (MAXVA - (1L << 30))
+#define MMIO_VA(pa) (KERNEL_MMIO_BASE + (pa))
+
+// 16550 寄存器 (每个 1 字节)
+#define RHR 0   // 接收保持寄存器 (读)
+#define IER 1   // 中断使能
+#define FCR 2   // FIFO 控制 (写)
+#define LSR 5   // 线路状态
+
+#define IER_RX_ENABLE (1 << 0)
+#define FCR_FIFO_ENABLE (1 << 0)
+#define FCR_FIFO_CLEAR (3 << 1)
+#define LSR_RX_READY (1 << 0)
+
+#define UART_REG(r) ((volatile uint8_t *)(MMIO_VA(UART0) + (r)))
+#define ReadReg(r) (*UART_REG(r))
+#define WriteReg(r, v) (*UART_REG(r) = (v))
+
+// 波特率和帧格式沿用固件的设置，只打开 FIFO 和接收中断
+// 需要在开启分页之后调用 (寄存器映射在 MMIO 窗口里)
+void uart_init() {
+    WriteReg(FCR, FCR_FIFO_ENABLE | FCR_FIFO_CLEAR);
+    WriteReg(IER, IER_RX_ENABLE);
+    printf("[Kernel] UART RX interrupt enabled.\n");
+}
+
+// 外部中断处理：把 FIFO 里的字符全部交给 TTY 行规程
+void uart_intr() {
+    while (ReadReg(LSR) & LSR_RX_READY) {
+        tty_input(ReadReg(RHR));
+    }
+}
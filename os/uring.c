@@ -0,0 +1,194 @@
+// os/uring.c
+// 共享内存的提交/完成队列 (仿 io_uring)
+// 以前用户程序每做一件事都要一次 ecall：__alltraps 保存 32 个寄存器、trap_handler、syscall 分发、再全部恢复
+// 现在用户把一批操作写进提交队列 (SQ)，一次 sys_uring_enter 全部处理，结果写进完成队列 (CQ)
+// 轮询模式 (URING_SQPOLL) 下连 enter 都不用：本进程被时钟中断打断时内核顺便把 SQ 处理掉
+//
+// 环放在一页里，映射到每个进程固定的用户地址 URING_VA，内核通过恒等映射直接访问：
+//   [0, 64)        RingHeader
+//   [64, 2112)     64 个 Sqe
+//   [2112, 3136)   64 个 Cqe
+// 用户写 sq_tail / 读 cq_tail，内核写 sq_head / cq_tail；用户读完 CQE 后推进 cq_head
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void* frame_alloc();
+void frame_dealloc(void *pa);
+typedef uint64_t* pagetable_t;
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+void console_write(char *buf, uint64_t len);
+int tty_read(char *buf, int len);
+void task_yield();
+int task_current_pid();
+pagetable_t task_pagetable();
+void* task_get_uring(int *flags);
+void task_set_uring(void *ring, int flags);
+
+#define PAGE_SIZE 4096
+#define PTE_R (1L << 1)
+#define PTE_W (1L << 2)
+#define PTE_U (1L << 4)
+
+// 和 user/app.c 里的定义保持一致
+#define URING_VA 0x70000000L
+#define USER_TOP 0x80000000L
+#define URING_ENTRIES 64
+#define URING_SQPOLL 1
+
+#define URING_OP_NOP    0
+#define URING_OP_WRITE  1   // fd, addr, len
+#define URING_OP_READ   2   // fd, addr, len (可能睡眠)
+#define URING_OP_YIELD  3
+#define URING_OP_GETPID 4
+
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+    uint32_t flags;
+    uint64_t dropped;       // CQ 满了没地方放的完成事件数
+    uint64_t reserved[5];
+} RingHeader;
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t pad;
+    int32_t fd;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t pad2;
+    uint64_t user_data;
+} Sqe;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t res;
+} Cqe;
+
+#define RING_SQES(r) ((Sqe *)((char *)(r) + 64))
+#define RING_CQES(r) ((Cqe *)((char *)(r) + 64 + URING_ENTRIES * sizeof(Sqe)))
+
+uint64_t uring_ops = 0;         // 所有进程通过环完成的操作数
+uint64_t uring_polled = 0;      // 其中由时钟中断轮询处理的
+
+// 建立当前进程的环，返回用户地址；已经建过就只更新 flags
+// 这一页不记成 VMA：它一直是映射着的，不会缺页 (fork 后的 COW 除外)，brk 也长不到这里
+uint64_t sys_uring_setup(int flags) {
+    int old_flags;
+    void *old = task_get_uring(&old_flags);
+    if (old) {
+        task_set_uring(old, flags);
+        return URING_VA;
+    }
+
+    RingHeader *r = (RingHeader *)frame_alloc();
+    if (r == 0) return -1;
+    r->entries = URING_ENTRIES;
+    r->flags = flags;
+
+    if (uvm_map(task_pagetable(), URING_VA, (uint64_t)r, PAGE_SIZE, PTE_R | PTE_W | PTE_U) != 0) {
+        frame_dealloc(r);
+        return -1;
+    }
+    task_set_uring(r, flags);
+    return URING_VA;
+}
+
+// SQE 里的缓冲区必须整个在用户空间里 (addr + len 不溢出、不超过 USER_TOP)
+// 内核的恒等映射也在页表里，不检查的话 READ 能往任意内核地址写、WRITE 能把内核内存打到串口
+static int user_range_ok(uint64_t addr, uint64_t len) {
+    return addr < USER_TOP && len <= USER_TOP - addr;
+}
+
+// 执行一个 SQE，返回结果 (和对应系统调用的返回值一样)
+// e 是从用户页里拷出来的副本，检查过的字段不会再被用户改掉
+static int64_t uring_exec(Sqe *e) {
+    if ((e->opcode == URING_OP_WRITE || e->opcode == URING_OP_READ) && !user_range_ok(e->addr, e->len)) {
+        return -1;
+    }
+    switch (e->opcode) {
+    case URING_OP_NOP:
+        return 0;
+    case URING_OP_WRITE:
+        if (e->fd != 1 && e->fd != 2) return -1;
+        console_write((char *)e->addr, e->len);
+        return e->len;
+    case URING_OP_READ: {
+        if (e->fd != 0 || e->len == 0) return -1;
+        char kbuf[128];
+        int n = tty_read(kbuf, e->len < sizeof(kbuf) ? e->len : sizeof(kbuf));
+        // 放开 TTY 锁以后再写用户缓冲区
+        for (int i = 0; i < n; i++) ((char *)e->addr)[i] = kbuf[i];
+        return n;
+    }
+    case URING_OP_YIELD:
+        task_yield();
+        return 0;
+    case URING_OP_GETPID:
+        return task_current_pid();
+    default:
+        return -1;
+    }
+}
+
+// 处理 SQ 里所有已提交的操作，返回处理的个数；队列的头尾不合法时返回 -1
+// can_block 为 0 时 (时钟中断里轮询) 遇到会睡眠或让出 CPU 的操作就停下，留给 enter
+// 头尾都在用户可写的页里：各读一次放进局部变量，之后只信自己的副本
+// 一次最多处理 URING_ENTRIES 个，用户把 tail 改成乱七八糟的值也不会让内核关着中断转几十亿圈
+static int uring_drain(RingHeader *r, int can_block) {
+    Sqe *sqes = RING_SQES(r);
+    Cqe *cqes = RING_CQES(r);
+    uint32_t head = r->sq_head;
+    uint32_t tail = r->sq_tail;
+    if (tail - head > URING_ENTRIES) return -1;
+    int done = 0;
+
+    while (head != tail) {
+        // 先看到 tail 再读 SQE 内容 (和用户的写入顺序配对)
+        __sync_synchronize();
+        Sqe e = sqes[head % URING_ENTRIES];
+        if (!can_block && (e.opcode == URING_OP_READ || e.opcode == URING_OP_YIELD)) break;
+        head++;
+        r->sq_head = head;
+
+        int64_t res = uring_exec(&e);
+
+        if (r->cq_tail - r->cq_head < URING_ENTRIES) {
+            Cqe *c = &cqes[r->cq_tail % URING_ENTRIES];
+            c->user_data = e.user_data;
+            c->res = res;
+            // CQE 写完再推进 tail
+            __sync_synchronize();
+            r->cq_tail++;
+        } else {
+            r->dropped++;
+        }
+        done++;
+    }
+    __sync_fetch_and_add(&uring_ops, done);
+    return done;
+}
+
+// 一次系统调用处理整批提交，返回处理的个数
+int sys_uring_enter() {
+    int flags;
+    RingHeader *r = (RingHeader *)task_get_uring(&flags);
+    if (r == 0) return -1;
+    return uring_drain(r, 1);
+}
+
+// 时钟中断打断用户态时调用：轮询模式下顺便处理当前进程的 SQ
+void uring_poll() {
+    int flags;
+    RingHeader *r = (RingHeader *)task_get_uring(&flags);
+    if (r == 0 || !(flags & URING_SQPOLL)) return;
+    int done = uring_drain(r, 0);
+    if (done > 0) __sync_fetch_and_add(&uring_polled, done);
+}
+
+void uring_stats() {
+    printf("[Kernel] uring: ops=%lu, polled=%lu\n", uring_ops, uring_polled);
+}
@@ -0,0 +1,78 @@
+// os/vdso.c
+// vDSO：映射进每个用户地址空间的只读页，读时间、PID、时钟中断计数不用陷入内核
+//   VDSO_DATA_VA  所有进程共享的一页：timebase 频率、开机时的 rdtime、时钟中断计数
+//   VDSO_PROC_VA  每个进程自己的一页：PID
+// 内核通过恒等映射直接写这两页，用户态只有 R 权限
+// 所有字段都是对齐的 64 位，单次读写不会被撕裂，不需要序号锁
+#include <stdint.h>
+
+void printf(char *fmt, ...);
+void* frame_alloc();
+void frame_ref(void *pa);
+void frame_dealloc(void *pa);
+typedef uint64_t* pagetable_t;
+int uvm_map(pagetable_t pagetable, uint64_t va, uint64_t pa, uint64_t size, int perm);
+void uvm_unmap(pagetable_t pagetable, uint64_t va, uint64_t npages);
+
+#define PAGE_SIZE 4096
+#define PTE_R (1L << 1)
+#define PTE_U (1L << 4)
+
+// 和 task.c、user/ 里的定义保持一致：紧挨在提交/完成队列页 (0x70000000) 下面
+#define VDSO_DATA_VA 0x6FFFE000L
+#define VDSO_PROC_VA 0x6FFFF000L
+
+#define CLOCK_FREQ 10000000     // QEMU virt 的 timebase 频率
+
+typedef struct {
+    uint64_t timebase_freq;     // rdtime 每秒增加的次数
+    uint64_t time_offset;       // 开机时的 rdtime，rdtime - time_offset 是开机以来的时间
+    volatile uint64_t ticks;    // 时钟中断次数 (所有 hart 合计)
+} VdsoData;
+
+typedef struct {
+    uint64_t pid;
+} VdsoProc;
+
+static VdsoData *vdso_data = 0;
+
+// 开机时调用一次 (mm_init 之后)
+void vdso_init() {
+    vdso_data = (VdsoData *)frame_alloc();
+    vdso_data->timebase_freq = CLOCK_FREQ;
+    asm volatile("rdtime %0" : "=r"(vdso_data->time_offset));
+    printf("[Kernel] vDSO data page at %p\n", vdso_data);
+}
+
+// 时钟中断里调用
+void vdso_tick() {
+    __sync_fetch_and_add(&vdso_data->ticks, 1);
+}
+
+static int map_proc_page(pagetable_t pt, int pid) {
+    VdsoProc *p = (VdsoProc *)frame_alloc();
+    if (p == 0) return -1;
+    p->pid = pid;
+    if (uvm_map(pt, VDSO_PROC_VA, (uint64_t)p, PAGE_SIZE, PTE_R | PTE_U) != 0) {
+        frame_dealloc(p);
+        return -1;
+    }
+    return 0;
+}
+
+// 把两页映射进新建的地址空间 (加载程序时)
+// 共享页多一个引用，随地址空间释放时减掉，内核自己的那个引用永远不放
+int vdso_map(pagetable_t pt, int pid) {
+    frame_ref(vdso_data);
+    if (uvm_map(pt, VDSO_DATA_VA, (uint64_t)vdso_data, PAGE_SIZE, PTE_R | PTE_U) != 0) {
+        frame_dealloc(vdso_data);
+        return -1;
+    }
+    return map_proc_page(pt, pid);
+}
+
+// fork 出的子进程：uvm_copy 让它和父进程共享了进程页，换成自己的一页
+int vdso_fork(pagetable_t child_pt, int pid) {
+    uvm_unmap(child_pt, VDSO_PROC_VA, 1);
+    return map_proc_page(child_pt, pid);
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+# tools/trace_report.py
+# 解析内核 trace dump (shell 里执行 `trace dump` 打到串口的内容)，
+# 输出系统调用 / Trap 的延迟直方图和每个 hart 的任务时间线
+#
+# 用法:
+#   make run | tee qemu.log          # 在 shell 里 trace on ... trace dump
+#   python3 tools/trace_report.py qemu.log
+#   python3 tools/trace_report.py qemu.log --chrome trace.json   # 用 chrome://tracing 或 Perfetto 打开
+import argparse
+import json
+import re
+import sys
+from collections import defaultdict
+
+LINE_RE = re.compile(
+    r"^T (\d+) (\d+) ([0-9a-f]+) (\w+) (\d+) ([0-9a-f]+) ([0-9a-f]+)\s*$"
+)
+
+SYSCALL_NAMES = {
+    29: "ioctl", 63: "read", 64: "write", 93: "exit", 101: "nanosleep", 116: "dmesg", 124: "yield",
+    172: "getpid", 214: "brk", 220: "fork", 221: "exec", 260: "waitpid",
+    401: "trace", 402: "shutdown", 404: "faultstat",
+    405: "meminfo", 406: "membench", 407: "forkfail",
+    425: "uring_setup", 426: "uring_enter",
+}
+
+INTERRUPT_BIT = 1 << 63
+SCAUSE_NAMES = {
+    INTERRUPT_BIT | 5: "timer_irq", INTERRUPT_BIT | 9: "external_irq",
+    8: "ecall_u", 12: "inst_page_fault", 13: "load_page_fault", 15: "store_page_fault",
+}
+
+
+def parse(lines):
+    """返回 (freq, events)，只取最后一段 TRACE-BEGIN ... TRACE-END"""
+    dumps = []
+    cur = None
+    freq = 10_000_000
+    for line in lines:
+        # 串口输出可能夹着回车
+        line = line.strip("\r\n").strip()
+        if line.startswith("TRACE-BEGIN"):
+            m = re.search(r"freq=(\d+)", line)
+            if m:
+                freq = int(m.group(1))
+            cur = []
+        elif line.startswith("TRACE-END"):
+            if cur is not None:
+                dumps.append(cur)
+            cur = None
+        elif cur is not None:
+            m = LINE_RE.match(line)
+            if not m:
+                continue
+            hart, t, cyc, name, pid, a, b = m.groups()
+            cur.append({
+                "hart": int(hart),
+                "t": int(t),
+                "cycle": int(cyc, 16),
+                "name": name,
+                "pid": int(pid),
+                "a": int(a, 16),
+                "b": int(b, 16),
+            })
+    if not dumps:
+        return freq, []
+    events = dumps[-1]
+    events.sort(key=lambda e: (e["t"], e["hart"]))
+    return freq, events
+
+
+def histogram(title, samples_us):
+    """以 2 的幂为桶的直方图 (单位 us)"""
+    if not samples_us:
+        return
+    buckets = defaultdict(int)
+    for v in samples_us:
+        b = 0
+        while (1 << b) <= v:
+            b += 1
+        buckets[b] += 1
+    n = len(samples_us)
+    srt = sorted(samples_us)
+    print(f"{title}: n={n} avg={sum(srt) / n:.1f}us p50={srt[n // 2]:.1f}us "
+          f"p99={srt[min(n - 1, n * 99 // 100)]:.1f}us max={srt[-1]:.1f}us")
+    peak = max(buckets.values())
+    for b in range(min(buckets), max(buckets) + 1):
+        lo = 0 if b == 0 else 1 << (b - 1)
+        hi = 1 << b
+        cnt = buckets.get(b, 0)
+        bar = "#" * max(1 if cnt else 0, cnt * 40 // peak)
+        print(f"  [{lo:>7}, {hi:>7}) us {cnt:>6} {bar}")
+    print()
+
+
+def report(freq, events):
+    to_us = 1e6 / freq
+
+    by_syscall = defaultdict(list)
+    by_trap = defaultdict(list)
+    counts = defaultdict(int)
+    for e in events:
+        counts[e["name"]] += 1
+        if e["name"] == "syscall":
+            by_syscall[e["a"]].append(e["b"] * to_us)
+        elif e["name"] == "trap_exit":
+            by_trap[e["a"]].append(e["b"] * to_us)
+
+    span = (events[-1]["t"] - events[0]["t"]) * to_us if events else 0
+    print(f"{len(events)} events over {span:.0f}us on harts "
+          f"{sorted({e['hart'] for e in events})}")
+    print("  " + ", ".join(f"{k}={v}" for k, v in sorted(counts.items())))
+    print()
+
+    for num, samples in sorted(by_syscall.items()):
+        histogram(f"syscall {SYSCALL_NAMES.get(num, num)}", samples)
+    for cause, samples in sorted(by_trap.items()):
+        histogram(f"trap {SCAUSE_NAMES.get(cause, hex(cause))}", samples)
+
+    # 文本时间线：每个 hart 上依次运行的任务
+    print("timeline (switches):")
+    for e in events:
+        if e["name"] == "switch":
+            nxt = e["b"] if e["b"] else "idle"
+            print(f"  {e['t'] * to_us:>12.1f}us hart{e['hart']}: {e['a']} -> {nxt}")
+        elif e["name"] == "fork":
+            print(f"  {e['t'] * to_us:>12.1f}us hart{e['hart']}: fork {e['a']} -> {e['b']}")
+
+
+def chrome_trace(freq, events, path):
+    """Chrome trace event 格式：任务运行区间 + 系统调用区间 + 瞬时事件"""
+    to_us = 1e6 / freq
+    out = []
+    running = {}    # hart -> (pid, 开始时间)
+    for e in events:
+        ts = e["t"] * to_us
+        tid = e["hart"]
+        if e["name"] == "switch":
+            if tid in running:
+                pid, start = running.pop(tid)
+                out.append({"name": f"pid {pid}", "ph": "X", "pid": 0, "tid": tid,
+                            "ts": start, "dur": ts - start})
+            if e["b"]:
+                running[tid] = (e["b"], ts)
+        elif e["name"] == "syscall":
+            dur = e["b"] * to_us
+            out.append({"name": f"sys_{SYSCALL_NAMES.get(e['a'], e['a'])}", "ph": "X",
+                        "pid": 1, "tid": tid, "ts": ts - dur, "dur": dur,
+                        "args": {"task": e["pid"]}})
+        elif e["name"] in ("fork", "page_fault", "frame_alloc", "frame_free"):
+            out.append({"name": e["name"], "ph": "i", "s": "t", "pid": 1, "tid": tid,
+                        "ts": ts, "args": {"a": hex(e["a"]), "b": e["b"]}})
+    with open(path, "w") as f:
+        json.dump({"traceEvents": out, "displayTimeUnit": "ns"}, f)
+    print(f"wrote {len(out)} trace events to {path}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="ToyOS kernel trace report")
+    ap.add_argument("log", nargs="?", help="串口日志文件 (默认读 stdin)")
+    ap.add_argument("--chrome", metavar="OUT.json", help="额外输出 Chrome trace 格式的时间线")
+    args = ap.parse_args()
+
+    f = open(args.log, errors="replace") if args.log else sys.stdin
+    freq, events = parse(f)
+    if not events:
+        print("no TRACE-BEGIN/TRACE-END block found", file=sys.stderr)
+        return 1
+    report(freq, events)
+    if args.chrome:
+        chrome_trace(freq, events, args.chrome)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
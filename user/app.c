@@ -23,6 +23,138 @@ int sys_read(char *buf, int len) {
 void sys_exit(int code) { syscall(93, code, 0, 0); }
 void sys_yield() { syscall(124, 0, 0, 0); }
 int sys_fork() { return syscall(220, 0, 0, 0); }
+// 换成内核应用表里名为 name 的程序，成功时不返回
+int sys_exec(char *name) { return syscall(221, (uint64_t)name, 0, 0); }
+// 控制台 raw 模式开关：raw=1 时不回显、不攒行，返回之前的模式
+#define TTY_IOCTL_SETRAW 1
+int sys_ttyraw(int raw) { return syscall(29, 0, TTY_IOCTL_SETRAW, raw); }
+// 内核事件追踪：0 关闭, 1 打开, 2 导出到串口, 3 清空
+int sys_trace(int cmd) { return syscall(401, cmd, 0, 0); }
+// pid = -1 等待任意子进程；返回子进程 pid，没有子进程时返回 -1
+int sys_waitpid(int pid, int *exit_code) { return syscall(260, pid, (uint64_t)exit_code, 0); }
+
+// 堆：brk(0) 查询堆顶，返回调整后的堆顶 (用户地址都在 2GB 以下，int 放得下)
+uint64_t sys_brk(uint64_t addr) { return (uint32_t)syscall(214, addr, 0, 0); }
+// 把堆顶上移 n 字节 (n 可以是负数)，返回原来的堆顶，失败返回 -1
+char* sbrk(long n) {
+    uint64_t old = sys_brk(0);
+    if (sys_brk(old + n) != old + n) return (char *)-1;
+    return (char *)old;
+}
+// 可用的物理页数 (伙伴系统空闲页 + 清零页池)
+int sys_meminfo() { return syscall(405, 0, 0, 0); }
+// 让下一次 fork 在内核复制完地址空间之后失败 (测失败路径的泄漏)
+// 内核没用 FAULT_INJECT=1 编译时没有这个调用，返回 -1
+int sys_forkfail() { return syscall(407, 0, 0, 0); }
+// 睡眠 (内核用时间轮定时唤醒，期间不占 CPU)
+int sys_nanosleep(int64_t sec, int64_t nsec) {
+    int64_t req[2] = {sec, nsec};
+    return syscall(101, (uint64_t)req, 0, 0);
+}
+void sleep_ms(uint64_t ms) { sys_nanosleep(ms / 1000, ms % 1000 * 1000000); }
+// 当前进程的缺页计数：清零页、COW、栈扩展
+void sys_faultstat(uint64_t *out) { syscall(404, (uint64_t)out, 0, 0); }
+// 读内核日志环 (os/klog.c)：每行 "<级别>[秒.微秒] 内容"，返回读到的字节数
+int sys_dmesg(char *buf, int len) { return syscall(116, (uint64_t)buf, len, 0); }
+
+// --- 提交/完成队列 (内核 os/uring.c)：一批操作只需要一次 ecall，轮询模式下一次都不用 ---
+// 布局和内核保持一致：一页里依次是头部 (64 字节)、64 个 SQE、64 个 CQE
+#define URING_ENTRIES 64
+#define URING_SQPOLL 1      // 内核在时钟中断里替我们处理 SQ
+#define URING_OP_NOP    0
+#define URING_OP_WRITE  1
+#define URING_OP_READ   2
+#define URING_OP_YIELD  3
+#define URING_OP_GETPID 4
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t pad;
+    int32_t fd;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t pad2;
+    uint64_t user_data;
+} Sqe;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t res;
+} Cqe;
+
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+    uint32_t flags;
+    uint64_t dropped;
+    uint64_t reserved[5];
+    Sqe sqes[URING_ENTRIES];
+    Cqe cqes[URING_ENTRIES];
+} Ring;
+
+// 建立 (或改 flags) 本进程的队列，返回映射好的地址
+Ring* uring_setup(int flags) { return (Ring *)(uint64_t)(uint32_t)syscall(425, flags, 0, 0); }
+// 让内核处理所有已提交的操作，返回处理的个数
+int uring_enter() { return syscall(426, 0, 0, 0); }
+
+// 取一个空闲的 SQE，SQ 满了返回 0
+Sqe* uring_get_sqe(Ring *r) {
+    if (r->sq_tail - r->sq_head == URING_ENTRIES) return 0;
+    return &r->sqes[r->sq_tail % URING_ENTRIES];
+}
+
+// 填好的 SQE 对内核可见：先写内容，再推进 tail
+void uring_commit(Ring *r) {
+    __sync_synchronize();
+    r->sq_tail++;
+}
+
+void uring_prep_write(Sqe *e, char *buf, int len, uint64_t user_data) {
+    e->opcode = URING_OP_WRITE;
+    e->fd = 1;
+    e->addr = (uint64_t)buf;
+    e->len = len;
+    e->user_data = user_data;
+}
+
+// 取一个完成事件，没有返回 0；用完后调用 uring_cqe_seen
+Cqe* uring_peek_cqe(Ring *r) {
+    if (r->cq_head == r->cq_tail) return 0;
+    __sync_synchronize();
+    return &r->cqes[r->cq_head % URING_ENTRIES];
+}
+
+void uring_cqe_seen(Ring *r) { r->cq_head++; }
+
+// 读取 time CSR (内核通过 scounteren 允许用户态读取)
+uint64_t rdtime() {
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+// --- vDSO (内核 os/vdso.c)：内核维护的只读页，读时间和 PID 不用陷入内核 ---
+#define VDSO_DATA_VA 0x6FFFE000L
+#define VDSO_PROC_VA 0x6FFFF000L
+
+typedef struct {
+    uint64_t timebase_freq;     // rdtime 每秒增加的次数
+    uint64_t time_offset;       // 开机时的 rdtime
+    volatile uint64_t ticks;    // 时钟中断次数 (所有 hart 合计)
+} VdsoData;
+
+#define vdso ((VdsoData *)VDSO_DATA_VA)
+
+int vdso_getpid() { return *(uint64_t *)VDSO_PROC_VA; }
+uint64_t vdso_ticks() { return vdso->ticks; }
+// 开机以来的微秒数
+uint64_t vdso_uptime_us() {
+    return (rdtime() - vdso->time_offset) * 1000000 / vdso->timebase_freq;
+}
 
 // --- 字符串工具 ---
 int strcmp(const char *s1, const char *s2) {
@@ -33,30 +165,40 @@ int strcmp(const char *s1, const char *s2) {
     return *s1 - *s2;
 }
 
+// 打印一个无符号十进制数
+void print_num(uint64_t n) {
+    char buf[24];
+    int i = 23;
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    sys_write(&buf[i]);
+}
+
 // --- 行读取器 ---
+// 内核的行规程负责回显和退格，一次 sys_read 就能拿到整行
 void readline(char *buf, int max_len) {
-    int i = 0;
+    int n = 0;
+    while (n == 0) {
+        n = sys_read(buf, max_len - 1);
+    }
+    if (buf[n - 1] == '\n') n--;
+    buf[n] = '\0';
+}
+
+// --- raw 模式演示：逐键打印键码，按 q 退出 ---
+void run_keys() {
     char c;
-    while (1) {
-        if (sys_read(&c, 1) > 0) {
-            if (c == '\r' || c == '\n') {
-                sys_write("\n");
-                buf[i] = '\0';
-                break;
-            } else if (c == 127 || c == '\b') {
-                if (i > 0) {
-                    i--;
-                    sys_write("\b \b");
-                }
-            } else {
-                if (i < max_len - 1) {
-                    buf[i++] = c;
-                    char tmp[2] = {c, '\0'};
-                    sys_write(tmp);
-                }
-            }
-        }
+    sys_write("[Shell] raw mode, press keys (q to quit)\n");
+    sys_ttyraw(1);
+    while (sys_read(&c, 1) > 0 && c != 'q') {
+        print_num((uint8_t)c);
+        sys_write(" ");
     }
+    sys_ttyraw(0);
+    sys_write("\n");
 }
 
 // --- 模拟复杂的子进程任务 ---
@@ -65,13 +207,272 @@ void run_child_task() {
     sys_write("  [Child] working: ");
     for (int i = 0; i < 5; i++) {
         sys_write(".");
-        // 假装在忙，让出CPU
-        sys_yield();
+        // 假装在等 I/O：睡一会儿，不再 yield 空转
+        sleep_ms(20);
     }
     sys_write(" Done!\n");
     sys_exit(0);
 }
 
+// --- SMP 跑分：fork 出 N 个纯计算的子进程，等它们全部结束 ---
+// 在不同的 SMP=n 下运行，比较总耗时就能看出多核的扩展性
+#define SMP_WORKERS 4
+#define SMP_ITERS 20000000
+
+void run_smp_bench() {
+    uint64_t start = rdtime();
+
+    for (int i = 0; i < SMP_WORKERS; i++) {
+        int pid = sys_fork();
+        if (pid == 0) {
+            volatile uint64_t x = 0;
+            for (int j = 0; j < SMP_ITERS; j++) x += j;
+            sys_exit(0);
+        }
+    }
+    while (sys_waitpid(-1, 0) >= 0);
+
+    uint64_t elapsed = rdtime() - start;
+    sys_write("[Shell] smp: workers=");
+    print_num(SMP_WORKERS);
+    sys_write(" elapsed_ticks=");
+    print_num(elapsed);
+    sys_write("\n");
+}
+
+// --- 控制台吞吐量：大块 sys_write，算出每秒字节数 ---
+#define CLOCK_FREQ 10000000     // QEMU virt 的 timebase 频率
+#define WBENCH_CHUNK 1024
+#define WBENCH_ROUNDS 32
+
+void run_write_bench() {
+    char chunk[WBENCH_CHUNK + 1];
+    for (int i = 0; i < WBENCH_CHUNK; i++) {
+        chunk[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+    }
+    chunk[WBENCH_CHUNK] = '\0';
+
+    uint64_t start = rdtime();
+    for (int r = 0; r < WBENCH_ROUNDS; r++) {
+        sys_write(chunk);
+    }
+    uint64_t elapsed = rdtime() - start;
+    if (elapsed == 0) elapsed = 1;
+
+    uint64_t bytes = WBENCH_CHUNK * WBENCH_ROUNDS;
+    sys_write("[Shell] write: bytes=");
+    print_num(bytes);
+    sys_write(" elapsed_ticks=");
+    print_num(elapsed);
+    sys_write(" bytes_per_sec=");
+    print_num(bytes * CLOCK_FREQ / elapsed);
+    sys_write("\n");
+}
+
+// --- 提交队列 vs 普通 sys_write：同样写 URB_LINES 行短文本 ---
+// 1. 每行一次 sys_write
+// 2. 每 URB_BATCH 行进一次队列，一次 uring_enter
+// 3. 轮询模式：只管往队列里放，内核在时钟中断里处理，一次 ecall 都没有
+#define URB_LINES 256
+#define URB_BATCH 32
+
+void run_uring_bench() {
+    char line[] = "uring-bench ...\n";
+    int len = sizeof(line) - 1;
+    Ring *r = uring_setup(0);
+    uint64_t t_plain, t_ring, t_poll;
+
+    uint64_t start = rdtime();
+    for (int i = 0; i < URB_LINES; i++) sys_write(line);
+    t_plain = rdtime() - start;
+
+    start = rdtime();
+    for (int i = 0; i < URB_LINES; i += URB_BATCH) {
+        for (int j = 0; j < URB_BATCH; j++) {
+            uring_prep_write(uring_get_sqe(r), line, len, i + j);
+            uring_commit(r);
+        }
+        uring_enter();
+        while (uring_peek_cqe(r)) uring_cqe_seen(r);
+    }
+    t_ring = rdtime() - start;
+
+    uring_setup(URING_SQPOLL);
+    start = rdtime();
+    int done = 0, submitted = 0;
+    while (done < URB_LINES) {
+        Sqe *e;
+        while (submitted < URB_LINES && (e = uring_get_sqe(r))) {
+            uring_prep_write(e, line, len, submitted++);
+            uring_commit(r);
+        }
+        while (uring_peek_cqe(r)) {
+            uring_cqe_seen(r);
+            done++;
+        }
+    }
+    t_poll = rdtime() - start;
+    uring_setup(0);
+
+    sys_write("[Shell] uring: lines=");
+    print_num(URB_LINES);
+    sys_write(" sys_write_ticks=");
+    print_num(t_plain);
+    sys_write(" ring_ticks=");
+    print_num(t_ring);
+    sys_write(" sqpoll_ticks=");
+    print_num(t_poll);
+    sys_write("\n");
+}
+
+// --- 按需分页演示：堆只在碰到的页上花内存，栈缺页时自动向下长 ---
+#define VM_HEAP_PAGES 256
+#define VM_TOUCH_STRIDE 16
+
+int deep_stack(int depth) {
+    volatile char frame[1024];
+    frame[0] = depth;
+    if (depth == 0) return frame[0];
+    return deep_stack(depth - 1) + frame[0];
+}
+
+void print_faults(char *label) {
+    uint64_t st[3];
+    sys_faultstat(st);
+    sys_write(label);
+    sys_write(" zero=");
+    print_num(st[0]);
+    sys_write(" cow=");
+    print_num(st[1]);
+    sys_write(" stack=");
+    print_num(st[2]);
+    sys_write("\n");
+}
+
+void run_vm_demo() {
+    print_faults("[Shell] vm: start   ");
+
+    char *heap = sbrk(VM_HEAP_PAGES * 4096);
+    if (heap == (char *)-1) {
+        sys_write("[Shell] vm: sbrk failed\n");
+        return;
+    }
+    for (int i = 0; i < VM_HEAP_PAGES; i += VM_TOUCH_STRIDE) heap[i * 4096] = 1;
+    print_faults("[Shell] vm: heap    ");
+
+    deep_stack(32);
+    print_faults("[Shell] vm: stack   ");
+
+    sbrk(-(long)(VM_HEAP_PAGES * 4096));
+    sys_write("[Shell] vm: reserved ");
+    print_num(VM_HEAP_PAGES);
+    sys_write(" heap pages, touched ");
+    print_num(VM_HEAP_PAGES / VM_TOUCH_STRIDE);
+    sys_write("\n");
+}
+
+// --- vDSO 演示：开机时间、时钟中断次数、PID，全都不经过系统调用 ---
+void run_uptime() {
+    uint64_t us = vdso_uptime_us();
+    sys_write("[Shell] uptime: ");
+    print_num(us / 1000000);
+    sys_write(".");
+    print_num(us / 100000 % 10);
+    sys_write("s ticks=");
+    print_num(vdso_ticks());
+    sys_write(" pid=");
+    print_num(vdso_getpid());
+    sys_write("\n");
+}
+
+// --- 睡眠精度：睡 SLEEP_ROUNDS 次 SLEEP_MS 毫秒，看每次多睡了多久 ---
+#define SLEEP_ROUNDS 10
+#define SLEEP_MS 50
+
+void run_sleep_test() {
+    uint64_t late_total = 0, late_max = 0;
+    for (int i = 0; i < SLEEP_ROUNDS; i++) {
+        uint64_t t0 = rdtime();
+        sleep_ms(SLEEP_MS);
+        uint64_t late = rdtime() - t0 - SLEEP_MS * (CLOCK_FREQ / 1000);
+        late_total += late;
+        if (late > late_max) late_max = late;
+    }
+    sys_write("[Shell] sleep: ");
+    print_num(SLEEP_ROUNDS);
+    sys_write(" x ");
+    print_num(SLEEP_MS);
+    sys_write("ms, oversleep avg_us=");
+    print_num(late_total / SLEEP_ROUNDS / (CLOCK_FREQ / 1000000));
+    sys_write(" max_us=");
+    print_num(late_max / (CLOCK_FREQ / 1000000));
+    sys_write("\n");
+}
+
+// --- 泄漏检查：反复 fork + 子进程碰几页内存 + exit，前后比较可用物理页数 ---
+// 每轮再加一次故意失败的 fork：子进程的页表已经复制好了，要原样还回去
+// 先跑一轮预热：slab 缓存、清零页池等第一次会留下一些页，之后应该一页不差
+#define LEAK_CYCLES 50
+#define LEAK_TOUCH_PAGES 4
+
+char leak_buf[LEAK_TOUCH_PAGES * 4096] = {1};
+
+void leak_cycle() {
+    int pid = sys_fork();
+    if (pid == 0) {
+        // 写几页 .data (COW) 和一页堆 (按需清零)，让子进程有自己的页要还
+        for (int i = 0; i < LEAK_TOUCH_PAGES; i++) leak_buf[i * 4096] = 2;
+        char *heap = sbrk(4096);
+        if (heap != (char *)-1) heap[0] = 1;
+        sys_exit(0);
+    }
+    sys_waitpid(pid, 0);
+
+    // 内核不支持故障注入时跳过，否则下面的 fork 会真的成功
+    if (sys_forkfail() != 0) return;
+    if (sys_fork() == 0) sys_exit(1);   // 不该走到这里：fork 应该返回 -1
+    // 失败的 fork 把父进程的可写页降成了 COW，写一下让它们恢复可写
+    for (int i = 0; i < LEAK_TOUCH_PAGES; i++) leak_buf[i * 4096] = 3;
+}
+
+void run_leak_check() {
+    leak_cycle();
+    int before = sys_meminfo();
+    for (int i = 0; i < LEAK_CYCLES; i++) leak_cycle();
+    int after = sys_meminfo();
+
+    sys_write("[Shell] leak: cycles=");
+    print_num(LEAK_CYCLES);
+    sys_write(" pages before=");
+    print_num(before);
+    sys_write(" after=");
+    print_num(after);
+    sys_write(before == after ? " OK\n" : " LEAKED\n");
+}
+
+// --- dmesg：打印内核日志环 (和内核的环一样大，一次读完) ---
+#define DMESG_SIZE 16384
+char dmesg_buf[DMESG_SIZE];
+
+void run_dmesg() {
+    int n = sys_dmesg(dmesg_buf, DMESG_SIZE);
+    syscall(64, 1, (uint64_t)dmesg_buf, n);
+}
+
+// --- 运行内核里嵌入的另一个应用：fork + exec + waitpid ---
+void run_app(char *name) {
+    int pid = sys_fork();
+    if (pid == 0) {
+        sys_exec(name);
+        sys_write("[Shell] no such app: ");
+        sys_write(name);
+        sys_write("\n");
+        sys_exit(1);
+    }
+    int code;
+    sys_waitpid(pid, &code);
+}
+
 // --- 主程序 ---
 void main() {
     char cmd[128];
@@ -89,6 +490,17 @@ void main() {
             sys_write("Commands:\n");
             sys_write("  help - Show this message\n");
             sys_write("  test - Fork a child process to do work\n");
+            sys_write("  smp  - Fork compute workers and time them\n");
+            sys_write("  write - Measure console sys_write throughput\n");
+            sys_write("  keys - Print key codes in raw mode\n");
+            sys_write("  trace on|off|dump|clear - Kernel event trace\n");
+            sys_write("  run <app> - Run an embedded app (shell, bench)\n");
+            sys_write("  vm   - Demand paging: sbrk, touch, grow stack\n");
+            sys_write("  uring - Batched writes via shared rings vs sys_write\n");
+            sys_write("  uptime - Time, ticks and pid read from the vDSO page\n");
+            sys_write("  sleep - Check nanosleep wakeup precision\n");
+            sys_write("  leak - Free pages before/after fork+exit and failed-fork cycles\n");
+            sys_write("  dmesg - Print the kernel log ring\n");
             sys_write("  exit - Shutdown OS\n");
         } 
         else if (strcmp(cmd, "test") == 0) {
@@ -106,8 +518,53 @@ void main() {
                     sys_yield();
                 }
                 sys_write("\n[Shell] Parent loop done.\n");
+                int code;
+                sys_waitpid(pid, &code);
+                sys_write("[Shell] Child reaped.\n");
             }
         }
+        else if (strcmp(cmd, "smp") == 0) {
+            run_smp_bench();
+        }
+        else if (strcmp(cmd, "write") == 0) {
+            run_write_bench();
+        }
+        else if (strcmp(cmd, "keys") == 0) {
+            run_keys();
+        }
+        else if (strcmp(cmd, "trace on") == 0) {
+            sys_trace(1);
+        }
+        else if (strcmp(cmd, "trace off") == 0) {
+            sys_trace(0);
+        }
+        else if (strcmp(cmd, "trace dump") == 0) {
+            sys_trace(2);
+        }
+        else if (strcmp(cmd, "trace clear") == 0) {
+            sys_trace(3);
+        }
+        else if (strcmp(cmd, "vm") == 0) {
+            run_vm_demo();
+        }
+        else if (strcmp(cmd, "uring") == 0) {
+            run_uring_bench();
+        }
+        else if (strcmp(cmd, "uptime") == 0) {
+            run_uptime();
+        }
+        else if (strcmp(cmd, "sleep") == 0) {
+            run_sleep_test();
+        }
+        else if (strcmp(cmd, "leak") == 0) {
+            run_leak_check();
+        }
+        else if (strcmp(cmd, "dmesg") == 0) {
+            run_dmesg();
+        }
+        else if (cmd[0] == 'r' && cmd[1] == 'u' && cmd[2] == 'n' && cmd[3] == ' ') {
+            run_app(cmd + 4);
+        }
         else if (strcmp(cmd, "exit") == 0) {
             sys_write("System Halt.\n");
             sys_exit(0);
@@ -0,0 +1,289 @@
+// user/bench.c
+// 微基准测试：make bench 时作为开机的第一个进程运行，跑完后关机
+// (shell 里也可以 run bench)
+// 每个指标输出一行 bench.<名字>=<数值>，方便不同内核之间 diff
+// 时间用 rdtime (10MHz，1 tick = 100ns)，周期数用 rdcycle
+#include <stdint.h>
+
+// --- 系统调用封装 ---
+int syscall(int which, uint64_t arg0, uint64_t arg1, uint64_t arg2) {
+    register uint64_t a0 asm("a0") = arg0;
+    register uint64_t a1 asm("a1") = arg1;
+    register uint64_t a2 asm("a2") = arg2;
+    register uint64_t a7 asm("a7") = which;
+    asm volatile("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a7) : "memory");
+    return a0;
+}
+
+int sys_write_n(char *buf, int len) { return syscall(64, 1, (uint64_t)buf, len); }
+void sys_exit(int code) { syscall(93, code, 0, 0); }
+void sys_yield() { syscall(124, 0, 0, 0); }
+int sys_fork() { return syscall(220, 0, 0, 0); }
+int sys_getpid() { return syscall(172, 0, 0, 0); }
+int sys_waitpid(int pid, int *exit_code) { return syscall(260, pid, (uint64_t)exit_code, 0); }
+void sys_shutdown() { syscall(402, 0, 0, 0); }
+int sys_meminfo() { return syscall(405, 0, 0, 0); }
+int sys_forkfail() { return syscall(407, 0, 0, 0); }
+int sys_nanosleep(int64_t *req) { return syscall(101, (uint64_t)req, 0, 0); }
+int sys_membench(int op, int variant) { return syscall(406, op, variant, 0); }
+
+uint64_t rdtime() {
+    uint64_t t;
+    asm volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+uint64_t rdcycle() {
+    uint64_t c;
+    asm volatile("rdcycle %0" : "=r"(c));
+    return c;
+}
+
+#define NS_PER_TICK 100     // 10MHz timebase
+
+// --- 输出：一个指标拼成一整行，一次 sys_write 写出，不会被内核日志打断 ---
+void report(char *name, char *unit, uint64_t value) {
+    char line[96];
+    int n = 0;
+    char *prefix = "bench.";
+    while (*prefix) line[n++] = *prefix++;
+    while (*name) line[n++] = *name++;
+    line[n++] = '.';
+    while (*unit) line[n++] = *unit++;
+    line[n++] = '=';
+
+    char digits[24];
+    int d = 0;
+    do {
+        digits[d++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (d > 0) line[n++] = digits[--d];
+    line[n++] = '\n';
+    sys_write_n(line, n);
+}
+
+// 每次操作的平均耗时
+void report_per_op(char *name, uint64_t ticks, uint64_t cycles, uint64_t ops) {
+    report(name, "ns", ticks * NS_PER_TICK / ops);
+    report(name, "cycles", cycles / ops);
+}
+
+// --- 1. 空系统调用 ---
+#define NULL_ITERS 10000
+
+void bench_null_syscall() {
+    uint64_t t0 = rdtime(), c0 = rdcycle();
+    for (int i = 0; i < NULL_ITERS; i++) sys_getpid();
+    report_per_op("null_syscall", rdtime() - t0, rdcycle() - c0, NULL_ITERS);
+}
+
+// --- 1b. 同样的查询走 vDSO 页 (os/vdso.c)：只是一次内存读，不陷入内核 ---
+#define VDSO_DATA_VA 0x6FFFE000L
+#define VDSO_PROC_VA 0x6FFFF000L
+
+void bench_vdso() {
+    volatile uint64_t sink;
+    uint64_t t0 = rdtime(), c0 = rdcycle();
+    for (int i = 0; i < NULL_ITERS; i++) sink = *(volatile uint64_t *)VDSO_PROC_VA;
+    report_per_op("vdso_getpid", rdtime() - t0, rdcycle() - c0, NULL_ITERS);
+
+    // 开机以来的时间：rdtime - time_offset (数据页的第 2 个字段)
+    t0 = rdtime();
+    c0 = rdcycle();
+    for (int i = 0; i < NULL_ITERS; i++) sink = rdtime() - ((volatile uint64_t *)VDSO_DATA_VA)[1];
+    report_per_op("vdso_uptime", rdtime() - t0, rdcycle() - c0, NULL_ITERS);
+    (void)sink;
+}
+
+// --- 2. yield 乒乓：父子进程轮流 yield，每次 yield 是一次切换 ---
+// 单 hart (make bench 默认 BENCH_SMP=1) 下才是真正的乒乓
+#define YIELD_ITERS 2000
+
+void bench_yield_pingpong() {
+    int pid = sys_fork();
+    if (pid == 0) {
+        for (int i = 0; i < YIELD_ITERS; i++) sys_yield();
+        sys_exit(0);
+    }
+    uint64_t t0 = rdtime(), c0 = rdcycle();
+    for (int i = 0; i < YIELD_ITERS; i++) sys_yield();
+    uint64_t t = rdtime() - t0, c = rdcycle() - c0;
+    sys_waitpid(pid, 0);
+    // 父进程的每一轮包含两次切换 (父 -> 子 -> 父)
+    report_per_op("yield_switch", t, c, 2 * YIELD_ITERS);
+}
+
+// --- 3. fork + exit + waitpid ---
+#define FORK_ITERS 50
+
+// 同时检查泄漏：前面的 yield 测试已经 fork 过一次 (slab 等已经预热)，
+// 这 FORK_ITERS 轮前后可用物理页数应该一样
+void bench_fork_exit() {
+    int before = sys_meminfo();
+    uint64_t t0 = rdtime(), c0 = rdcycle();
+    for (int i = 0; i < FORK_ITERS; i++) {
+        int pid = sys_fork();
+        if (pid == 0) sys_exit(0);
+        sys_waitpid(pid, 0);
+    }
+    report_per_op("fork_exit", rdtime() - t0, rdcycle() - c0, FORK_ITERS);
+    // 失败的 fork (内核在复制完地址空间后故意失败) 也不能留下页表页
+    // 只有 make bench FAULT_INJECT=1 编出来的内核支持，否则 sys_forkfail 返回 -1，跳过
+    for (int i = 0; i < FORK_ITERS; i++) {
+        if (sys_forkfail() != 0) break;
+        if (sys_fork() == 0) sys_exit(1);
+    }
+    int after = sys_meminfo();
+    report("fork_exit_leak", "pages", before > after ? before - after : 0);
+}
+
+// --- 4. sys_write 吞吐量 ---
+#define WRITE_CHUNK 1024
+#define WRITE_ROUNDS 16
+
+char write_chunk[WRITE_CHUNK];
+
+void bench_write() {
+    for (int i = 0; i < WRITE_CHUNK; i++) {
+        write_chunk[i] = (i % 64 == 63) ? '\n' : '.';
+    }
+    uint64_t t0 = rdtime();
+    for (int r = 0; r < WRITE_ROUNDS; r++) sys_write_n(write_chunk, WRITE_CHUNK);
+    uint64_t t = rdtime() - t0;
+    if (t == 0) t = 1;
+
+    uint64_t bytes = WRITE_CHUNK * WRITE_ROUNDS;
+    report("write", "bytes", bytes);
+    report("write", "bytes_per_sec", bytes * (1000000000 / NS_PER_TICK) / t);
+}
+
+// --- 5. 缺页 (写时复制)：fork 之后子进程逐页写，每页触发一次 COW 缺页 ---
+// 数组放在 .data 里 (有初值)：加载时就映射好了，fork 之后是共享的 COW 页
+// (放在 .bss 里的话第一次访问测到的是按需清零缺页)
+#define FAULT_PAGES 8
+#define PAGE_SIZE 4096
+
+char fault_buf[FAULT_PAGES * PAGE_SIZE] = {1};
+
+void bench_page_fault() {
+    int pid = sys_fork();
+    if (pid == 0) {
+        uint64_t t0 = rdtime(), c0 = rdcycle();
+        for (int i = 0; i < FAULT_PAGES; i++) fault_buf[i * PAGE_SIZE] = 2;
+        report_per_op("cow_fault", rdtime() - t0, rdcycle() - c0, FAULT_PAGES);
+        sys_exit(0);
+    }
+    sys_waitpid(pid, 0);
+}
+
+// --- 6. 小块写：每次一个系统调用 vs 提交队列里一批一次 ecall (os/uring.c) ---
+// 每次写一行 16 字节，比较每次操作的平均开销
+#define SMALL_WRITES 512
+#define RING_BATCH 32
+#define URING_ENTRIES 64
+#define URING_OP_WRITE 1
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t pad;
+    int32_t fd;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t pad2;
+    uint64_t user_data;
+} Sqe;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t res;
+} Cqe;
+
+// 和 user/app.c 的 Ring 一样
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+    uint32_t flags;
+    uint64_t dropped;
+    uint64_t reserved[5];
+    Sqe sqes[URING_ENTRIES];
+    Cqe cqes[URING_ENTRIES];
+} Ring;
+
+void bench_small_write() {
+    char *line = "bench: ........\n";
+
+    uint64_t t0 = rdtime(), c0 = rdcycle();
+    for (int i = 0; i < SMALL_WRITES; i++) sys_write_n(line, 16);
+    report_per_op("small_write", rdtime() - t0, rdcycle() - c0, SMALL_WRITES);
+
+    Ring *r = (Ring *)(uint64_t)(uint32_t)syscall(425, 0, 0, 0);
+    t0 = rdtime();
+    c0 = rdcycle();
+    for (int i = 0; i < SMALL_WRITES; i += RING_BATCH) {
+        for (int j = 0; j < RING_BATCH; j++) {
+            Sqe *e = &r->sqes[r->sq_tail % URING_ENTRIES];
+            e->opcode = URING_OP_WRITE;
+            e->fd = 1;
+            e->addr = (uint64_t)line;
+            e->len = 16;
+            e->user_data = i + j;
+            __sync_synchronize();
+            r->sq_tail++;
+        }
+        syscall(426, 0, 0, 0);
+        r->cq_head = r->cq_tail;
+    }
+    report_per_op("uring_write", rdtime() - t0, rdcycle() - c0, SMALL_WRITES);
+}
+
+// --- 7. 睡眠唤醒延迟：睡 1ms，实际多睡了多久 (时间轮精度 1ms，向上取整) ---
+#define SLEEP_ITERS 20
+#define SLEEP_NS 1000000
+
+void bench_sleep() {
+    int64_t req[2] = {0, SLEEP_NS};
+    uint64_t late = 0;
+    for (int i = 0; i < SLEEP_ITERS; i++) {
+        uint64_t t0 = rdtime();
+        sys_nanosleep(req);
+        late += rdtime() - t0 - SLEEP_NS / NS_PER_TICK;
+    }
+    report("sleep_1ms_late", "ns", late * NS_PER_TICK / SLEEP_ITERS);
+}
+
+// --- 8. 内核整页复制/清零 (os/string.c)：按字节、按 64 位字展开、RVV 向量三个版本 ---
+// 在内核里测，每页的平均周期数；没有 V 扩展时不输出 rvv 那一项
+char *membench_names[2][3] = {
+    {"copy_page_byte", "copy_page_word", "copy_page_rvv"},
+    {"clear_page_byte", "clear_page_word", "clear_page_rvv"},
+};
+
+void bench_kernel_string() {
+    for (int op = 0; op < 2; op++) {
+        for (int v = 0; v < 3; v++) {
+            int cycles = sys_membench(op, v);
+            if (cycles < 0) continue;
+            report(membench_names[op][v], "cycles", cycles);
+        }
+    }
+}
+
+void main() {
+    sys_write_n("bench: start\n", 13);
+    bench_null_syscall();
+    bench_vdso();
+    bench_yield_pingpong();
+    bench_fork_exit();
+    bench_write();
+    bench_page_fault();
+    bench_small_write();
+    bench_sleep();
+    bench_kernel_string();
+    sys_write_n("bench: done\n", 12);
+    sys_shutdown();
+}